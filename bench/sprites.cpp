@@ -0,0 +1,60 @@
+#include "../mvke.hpp"
+#include "../image.hpp"
+#include "../sprites.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+// Draws quadsPerFrame sprites per frame into an offscreen canvas and
+// reports throughput. Every 64th quad switches texture, so batching is
+// exercised rather than one draw per frame.
+int main(int argc, char **argv) {
+  uint32_t quadsPerFrame = argc > 1 ? std::stoul(argv[1]) : 200000;
+  unsigned frames = argc > 2 ? std::stoul(argv[2]) : 200;
+  unsigned warmup = 10;
+
+  MVKE::Instance inst("Sprite Benchmark", 1, 0, 0, true);
+
+  uint32_t white = 0xffffffff;
+  uint32_t grey = 0xff808080;
+
+  MVKE::Texture a(inst, {1, 1}, vk::Format::eR8G8B8A8Unorm, false);
+  MVKE::Texture b(inst, {1, 1}, vk::Format::eR8G8B8A8Unorm, false);
+  a.upload(&white, sizeof white);
+  b.upload(&grey, sizeof grey);
+
+  vk::Extent2D extent = {1920, 1080};
+  MVKE::SpriteCanvas canvas(inst, extent, quadsPerFrame);
+
+  auto frame = [&](unsigned n) {
+    MVKE::SpriteBatch &batch = canvas.begin();
+
+    for (uint32_t i = 0; i < quadsPerFrame; ++i) {
+      if (i % 64 == 0) batch.setTexture((i / 64) % 2 ? b : a);
+
+      float x = static_cast<float>((i * 7 + n) % extent.width);
+      float y = static_cast<float>((i * 13) % extent.height);
+      batch.draw({x, y}, {8.0f, 8.0f});
+    }
+
+    canvas.submit();
+    return batch.stats();
+  };
+
+  for (unsigned n = 0; n < warmup; ++n) frame(n);
+  canvas.finish();
+
+  MVKE::SpriteBatch::Stats stats;
+  auto start = std::chrono::high_resolution_clock::now();
+
+  for (unsigned n = 0; n < frames; ++n) stats = frame(n);
+  canvas.finish();
+
+  std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  printf("%u frames of %u quads (%u batches) in %.3f s\n", frames, stats.quads, stats.batches, elapsed.count());
+  printf("%.3f ms/frame, %.1f M quads/s\n", elapsed.count() * 1000.0 / frames, double(quadsPerFrame) * frames / elapsed.count() / 1e6);
+
+  return 0;
+}
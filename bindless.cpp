@@ -0,0 +1,293 @@
+#include "bindless.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+#include "image.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using StageFlag = vk::ShaderStageFlagBits;
+const vk::ShaderStageFlags MVKE::BindlessTable::sStages = StageFlag::eVertex | StageFlag::eFragment | StageFlag::eCompute;
+
+std::vector<MVKE::DeviceFeature> MVKE::BindlessTable::deviceFeatures() {
+  auto indexing = MVKE::DeviceFeature::extension("descriptor indexing", VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, &MVKE::Capabilities::descriptorIndexing);
+
+  indexing.supported = [](const MVKE::FeatureChain &c) {
+    const auto &f = c.descriptorIndexing;
+
+    return f.shaderSampledImageArrayNonUniformIndexing
+      && f.shaderStorageBufferArrayNonUniformIndexing
+      && f.descriptorBindingSampledImageUpdateAfterBind
+      && f.descriptorBindingStorageBufferUpdateAfterBind
+      && f.descriptorBindingUpdateUnusedWhilePending
+      && f.descriptorBindingPartiallyBound
+      && f.runtimeDescriptorArray;
+  };
+
+  indexing.enable = [](MVKE::FeatureChain &c) {
+    auto &f = c.descriptorIndexing;
+
+    f.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    f.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    f.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    f.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    f.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    f.descriptorBindingPartiallyBound = VK_TRUE;
+    f.runtimeDescriptorArray = VK_TRUE;
+  };
+
+  // The fallback still picks array elements with a push constant.
+  return {
+    indexing,
+    MVKE::DeviceFeature::core("sampled image dynamic indexing", &vk::PhysicalDeviceFeatures::shaderSampledImageArrayDynamicIndexing, &MVKE::Capabilities::sampledImageDynamicIndexing),
+    MVKE::DeviceFeature::core("storage buffer dynamic indexing", &vk::PhysicalDeviceFeatures::shaderStorageBufferArrayDynamicIndexing, &MVKE::Capabilities::storageBufferDynamicIndexing),
+  };
+}
+
+MVKE::BindlessTable::BindlessTable(MVKE::Instance &inst, uint32_t capacity) : mInst(inst) {
+  const vk::PhysicalDevice &phys = mInst.mDevice->physDevice();
+
+  const auto &caps = mInst.mDevice->capabilities();
+
+  mBindless = caps.descriptorIndexing;
+  mEnabled = mBindless || (caps.sampledImageDynamicIndexing && caps.storageBufferDynamicIndexing);
+
+  if (!mEnabled) {
+    std::cerr << "Bindless table disabled: no dynamic descriptor array indexing" << std::endl;
+    return;
+  }
+
+  if (mBindless) {
+    auto chain = phys.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+    const auto &props = chain.get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+
+    mArrays[eImage].capacity = std::min({
+      capacity,
+      props.maxPerStageDescriptorUpdateAfterBindSampledImages,
+      props.maxDescriptorSetUpdateAfterBindSampledImages
+    });
+    mArrays[eStorageBuffer].capacity = std::min({
+      capacity,
+      props.maxPerStageDescriptorUpdateAfterBindStorageBuffers,
+      props.maxDescriptorSetUpdateAfterBindStorageBuffers
+    });
+  } else {
+    const auto &limits = mInst.mDevice->properties().limits;
+
+    mArrays[eImage].capacity = std::min({
+      capacity,
+      limits.maxPerStageDescriptorSampledImages,
+      limits.maxDescriptorSetSampledImages
+    });
+    mArrays[eStorageBuffer].capacity = std::min({
+      capacity,
+      limits.maxPerStageDescriptorStorageBuffers,
+      limits.maxDescriptorSetStorageBuffers
+    });
+  }
+
+  vk::DescriptorSetLayoutBinding bindings[] = {
+    {eImage, vk::DescriptorType::eCombinedImageSampler, mArrays[eImage].capacity, sStages},
+    {eStorageBuffer, vk::DescriptorType::eStorageBuffer, mArrays[eStorageBuffer].capacity, sStages},
+  };
+
+  vk::DescriptorSetLayoutCreateInfo layoutInfo(
+    vk::DescriptorSetLayoutCreateFlags(),
+    2,
+    bindings
+  );
+
+  using BindingFlag = vk::DescriptorBindingFlagBitsEXT;
+  vk::DescriptorBindingFlagsEXT bindingFlags[] = {
+    BindingFlag::eUpdateAfterBind | BindingFlag::eUpdateUnusedWhilePending | BindingFlag::ePartiallyBound,
+    BindingFlag::eUpdateAfterBind | BindingFlag::eUpdateUnusedWhilePending | BindingFlag::ePartiallyBound,
+  };
+
+  vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo(2, bindingFlags);
+
+  if (mBindless) {
+    layoutInfo.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT;
+    layoutInfo.pNext = &bindingFlagsInfo;
+  }
+
+  mLayout = mInst.mDevice->device().createDescriptorSetLayoutUnique(layoutInfo);
+
+  uint32_t copies = mBindless ? 1 : MAX_CONCURRENT_FRAMES;
+
+  vk::DescriptorPoolSize sizes[] = {
+    {vk::DescriptorType::eCombinedImageSampler, mArrays[eImage].capacity * copies},
+    {vk::DescriptorType::eStorageBuffer, mArrays[eStorageBuffer].capacity * copies},
+  };
+
+  mPool = mInst.mDevice->device().createDescriptorPoolUnique({
+    mBindless ? vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT : vk::DescriptorPoolCreateFlags(),
+    copies,
+    2,
+    sizes
+  });
+
+  std::vector<vk::DescriptorSetLayout> layouts(copies, *mLayout);
+  mSets = mInst.mDevice->device().allocateDescriptorSets({*mPool, copies, layouts.data()});
+
+  if (mBindless) return;
+
+  // Without partial binding every element must stay valid, so free and
+  // removed slots point at a white texel and a zeroed buffer until
+  // setDefaults() replaces them.
+  uint32_t white = 0xffffffff;
+
+  mDefaultTexture = std::make_shared<MVKE::Texture>(mInst, vk::Extent2D(1, 1), vk::Format::eR8G8B8A8Unorm, false);
+  mDefaultTexture->upload(&white, sizeof white);
+  mDefaultSampler = std::make_shared<MVKE::Sampler>(mInst, vk::Filter::eNearest);
+
+  mDefaultStorage = std::make_shared<MVKE::HighPerformanceBuffer>(mInst, 16, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst);
+
+  mInst.submitOneTime([&](const vk::CommandBuffer &cmd) {
+    cmd.fillBuffer(mDefaultStorage->buffer(), 0, VK_WHOLE_SIZE, 0);
+  });
+
+  setDefaults(
+    {mDefaultSampler->sampler(), mDefaultTexture->view(), vk::ImageLayout::eShaderReadOnlyOptimal},
+    {mDefaultStorage->buffer(), 0, VK_WHOLE_SIZE}
+  );
+}
+
+bool MVKE::BindlessTable::enabled() const { return mEnabled; }
+bool MVKE::BindlessTable::bindless() const { return mBindless; }
+
+MVKE::BindlessTable::Handle MVKE::BindlessTable::allocate(MVKE::BindlessTable::ResourceType type) {
+  Array &arr = mArrays[type];
+
+  if (!arr.free.empty()) {
+    Handle h = arr.free.back();
+    arr.free.pop_back();
+    return h;
+  }
+
+  if (arr.next == arr.capacity) {
+    throw std::runtime_error("Bindless descriptor array is full!");
+  }
+
+  return arr.next++;
+}
+
+MVKE::BindlessTable::Handle MVKE::BindlessTable::addImage(const vk::DescriptorImageInfo &info) {
+  if (!mEnabled) return sInvalid;
+
+  Handle h = allocate(eImage);
+  updateImage(h, info);
+  return h;
+}
+
+MVKE::BindlessTable::Handle MVKE::BindlessTable::addBuffer(const vk::DescriptorBufferInfo &info) {
+  if (!mEnabled) return sInvalid;
+
+  Handle h = allocate(eStorageBuffer);
+  updateBuffer(h, info);
+  return h;
+}
+
+void MVKE::BindlessTable::updateImage(MVKE::BindlessTable::Handle h, const vk::DescriptorImageInfo &info) {
+  write({eImage, h, info, vk::DescriptorBufferInfo()});
+}
+
+void MVKE::BindlessTable::updateBuffer(MVKE::BindlessTable::Handle h, const vk::DescriptorBufferInfo &info) {
+  write({eStorageBuffer, h, vk::DescriptorImageInfo(), info});
+}
+
+void MVKE::BindlessTable::remove(MVKE::BindlessTable::ResourceType type, MVKE::BindlessTable::Handle h) {
+  if (h == sInvalid) return;
+
+  // Frames still in flight may index this slot, so it only becomes reusable
+  // once the current frame slot comes round again.
+  mArrays[type].retired[mFrame].push_back(h);
+
+  if (!mBindless) {
+    write({type, h, mDefaultImage, mDefaultBuffer});
+  }
+}
+
+void MVKE::BindlessTable::setDefaults(const vk::DescriptorImageInfo &image, const vk::DescriptorBufferInfo &buffer) {
+  mDefaultImage = image;
+  mDefaultBuffer = buffer;
+
+  if (mBindless || !mEnabled) return;
+
+  std::vector<vk::DescriptorImageInfo> images(mArrays[eImage].capacity, image);
+  std::vector<vk::DescriptorBufferInfo> buffers(mArrays[eStorageBuffer].capacity, buffer);
+
+  std::vector<vk::WriteDescriptorSet> writes;
+
+  for (const auto &set : mSets) {
+    writes.push_back({set, eImage, 0, static_cast<uint32_t>(images.size()), vk::DescriptorType::eCombinedImageSampler, images.data()});
+    writes.push_back({set, eStorageBuffer, 0, static_cast<uint32_t>(buffers.size()), vk::DescriptorType::eStorageBuffer, nullptr, buffers.data()});
+  }
+
+  mInst.mDevice->device().updateDescriptorSets(writes, {});
+}
+
+void MVKE::BindlessTable::write(const MVKE::BindlessTable::Slot &slot) {
+  if (!mEnabled) return;
+
+  if (mBindless) {
+    apply(slot, 0);
+    return;
+  }
+
+  for (auto &pending : mPending) {
+    pending.push_back(slot);
+  }
+}
+
+void MVKE::BindlessTable::apply(const MVKE::BindlessTable::Slot &slot, size_t frame) {
+  vk::WriteDescriptorSet write(mSets[frame], slot.type, slot.index, 1, vk::DescriptorType::eCombinedImageSampler, &slot.image);
+
+  if (slot.type == eStorageBuffer) {
+    write.descriptorType = vk::DescriptorType::eStorageBuffer;
+    write.pImageInfo = nullptr;
+    write.pBufferInfo = &slot.buffer;
+  }
+
+  mInst.mDevice->device().updateDescriptorSets(write, {});
+}
+
+void MVKE::BindlessTable::flush(size_t frame) {
+  mFrame = frame;
+
+  for (auto &arr : mArrays) {
+    arr.free.insert(arr.free.end(), arr.retired[frame].begin(), arr.retired[frame].end());
+    arr.retired[frame].clear();
+  }
+
+  if (mBindless) return;
+
+  for (const auto &slot : mPending[frame]) {
+    apply(slot, frame);
+  }
+
+  mPending[frame].clear();
+}
+
+const vk::DescriptorSetLayout &MVKE::BindlessTable::layout() const { return *mLayout; }
+
+const vk::DescriptorSet &MVKE::BindlessTable::set(size_t frame) const {
+  if (!mEnabled) throw std::runtime_error("Bindless table is disabled!");
+
+  return mBindless ? mSets[0] : mSets[frame];
+}
+
+vk::PushConstantRange MVKE::BindlessTable::pushConstantRange() const {
+  return {sStages, 0, sizeof (BindlessIndices)};
+}
+
+void MVKE::BindlessTable::bind(const vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, size_t frame, uint32_t setIndex) const {
+  if (!mEnabled) return;
+
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, setIndex, set(frame), {});
+}
+
+void MVKE::BindlessTable::push(const vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, const MVKE::BindlessTable::BindlessIndices &indices) const {
+  if (!mEnabled) return;
+
+  cmd.pushConstants(layout, sStages, 0, sizeof indices, &indices);
+}
\ No newline at end of file
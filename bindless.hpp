@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <array>
+#include <memory>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // One large descriptor array per resource type, addressed by a stable index.
+  // Draws only push the indices they need (see BindlessIndices).
+  //
+  // With descriptor indexing the arrays are update-after-bind, partially
+  // bound and updatable while pending, so a single set is shared by every
+  // frame and writes to slots no frame in flight uses land immediately.
+  // Without it we fall back to one set per frame in flight, sized to the
+  // device limits; writes are queued and applied to each copy once that
+  // frame's fence has signalled, and unused slots point at default
+  // resources (a white texel and a zeroed buffer unless setDefaults() is
+  // given others). A device without even dynamic array indexing gets a
+  // disabled table: adds return sInvalid and binds do nothing, so callers
+  // must use their own descriptors.
+  class BindlessTable {
+  public:
+    enum ResourceType {
+      eImage = 0,
+      eStorageBuffer = 1,
+    };
+
+    using Handle = uint32_t;
+    static const Handle sInvalid = ~0u;
+
+    struct BindlessIndices {
+      uint32_t image;
+      uint32_t buffer;
+    };
+
+    BindlessTable(MVKE::Instance &inst, uint32_t capacity = 16384);
+
+    // Descriptor indexing, without which the table falls back to
+    // fixed-size arrays indexed dynamically.
+    static std::vector<MVKE::DeviceFeature> deviceFeatures();
+
+    bool enabled() const;
+    bool bindless() const;
+
+    Handle addImage(const vk::DescriptorImageInfo &info);
+    Handle addBuffer(const vk::DescriptorBufferInfo &info);
+    void updateImage(Handle h, const vk::DescriptorImageInfo &info);
+    void updateBuffer(Handle h, const vk::DescriptorBufferInfo &info);
+    void remove(ResourceType type, Handle h);
+
+    void setDefaults(const vk::DescriptorImageInfo &image, const vk::DescriptorBufferInfo &buffer);
+
+    void flush(size_t frame);
+
+    const vk::DescriptorSetLayout &layout() const;
+    const vk::DescriptorSet &set(size_t frame) const;
+    vk::PushConstantRange pushConstantRange() const;
+    void bind(const vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, size_t frame, uint32_t setIndex = 0) const;
+    void push(const vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, const BindlessIndices &indices) const;
+
+    static const vk::ShaderStageFlags sStages;
+  private:
+    struct Slot {
+      ResourceType type;
+      Handle index;
+      vk::DescriptorImageInfo image;
+      vk::DescriptorBufferInfo buffer;
+    };
+
+    struct Array {
+      uint32_t capacity;
+      uint32_t next = 0;
+      std::vector<Handle> free;
+      std::array<std::vector<Handle>, MAX_CONCURRENT_FRAMES> retired;
+    };
+
+    Handle allocate(ResourceType type);
+    void write(const Slot &slot);
+    void apply(const Slot &slot, size_t frame);
+
+    MVKE::Instance &mInst;
+
+    bool mEnabled;
+    bool mBindless;
+    size_t mFrame = 0;
+
+    std::array<Array, 2> mArrays;
+
+    vk::DescriptorImageInfo mDefaultImage;
+    vk::DescriptorBufferInfo mDefaultBuffer;
+
+    std::shared_ptr<MVKE::Texture> mDefaultTexture;
+    std::shared_ptr<MVKE::Sampler> mDefaultSampler;
+    std::shared_ptr<MVKE::Buffer> mDefaultStorage;
+
+    std::array<std::vector<Slot>, MAX_CONCURRENT_FRAMES> mPending;
+
+    vk::UniqueDescriptorSetLayout mLayout;
+    vk::UniqueDescriptorPool mPool;
+    std::vector<vk::DescriptorSet> mSets;
+  };
+}
\ No newline at end of file
@@ -6,9 +6,10 @@ MVKE::Buffer::Accessor::Accessor(MVKE::Buffer &buf, uint64_t offset, uint64_t si
 MVKE::Buffer::Accessor::~Accessor() { mBuf.unmap_buffer(mData, mOffset, mSize); }
 MVKE::Buffer::Accessor::operator void *() { return mData; }
 
-MVKE::Buffer::Buffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memUsage) : mInst(inst) {
+MVKE::Buffer::Buffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memUsage, VmaAllocationCreateFlags allocFlags) : mInst(inst) {
   VmaAllocationCreateInfo createInfo = {};
   createInfo.usage = memUsage;
+  createInfo.flags = allocFlags;
 
   vk::BufferCreateInfo bufferInfo(
     vk::BufferCreateFlags(),
@@ -70,6 +71,27 @@ void MVKE::MappableBuffer::unmap_buffer(void *data, uint64_t offset, uint64_t si
   mInst.mDevice->device().unmapMemory(mInfo.deviceMemory);
 }
 
+MVKE::PersistentBuffer::PersistentBuffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage)
+: MVKE::Buffer(inst, size, usage, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT) {}
+
+void *MVKE::PersistentBuffer::data() const {
+  return mInfo.pMappedData;
+}
+
+// A no-op on host-coherent memory.
+void MVKE::PersistentBuffer::flush(uint64_t offset, uint64_t size) {
+  vmaFlushAllocation(mInst.mAllocator, mAllocation, offset, size);
+}
+
+// offset is relative to the memory block; pMappedData to the allocation.
+void *MVKE::PersistentBuffer::map_buffer(uint64_t offset, uint64_t size) {
+  return static_cast<char *>(mInfo.pMappedData) + (offset - mInfo.offset);
+}
+
+void MVKE::PersistentBuffer::unmap_buffer(void *data, uint64_t offset, uint64_t size) {
+  flush(offset - mInfo.offset, size);
+}
+
 MVKE::StagedBuffer::StagedBuffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage)
 : MVKE::HighPerformanceBuffer(inst, size, usage | vk::BufferUsageFlagBits::eTransferDst) {}//, mFastBuffer(inst, size, usage | vk::BufferUsageFlagBits::eTransferDst) {}
 
@@ -83,14 +105,9 @@ void *MVKE::StagedBuffer::map_buffer(uint64_t offset, uint64_t size) {
 void MVKE::StagedBuffer::unmap_buffer(void *data, uint64_t offset, uint64_t size) {
   mInst.mDevice->device().unmapMemory(mStaging->memory());
 
-  auto bufs = mInst.mDevice->device().allocateCommandBuffersUnique({*mInst.mCommandPool, vk::CommandBufferLevel::ePrimary, 1});
-
-  bufs[0]->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-  bufs[0]->copyBuffer(mStaging->buffer(), mBuffer, {{0, offset, size}});
-  bufs[0]->end();
-
-  mInst.mQueues.graphics.submit({{0, nullptr, nullptr, 1, &bufs[0].get(), 0, nullptr}}, vk::Fence());
-  mInst.mQueues.graphics.waitIdle();
+  mInst.submitOneTime([&](const vk::CommandBuffer &cmd) {
+    cmd.copyBuffer(mStaging->buffer(), mBuffer, {{0, offset, size}});
+  });
 
   delete mStaging;
   mStaging = nullptr;
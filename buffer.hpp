@@ -25,7 +25,7 @@ namespace MVKE {
     virtual void unmap_buffer(void *data, uint64_t offset, uint64_t size) = 0;
 
   public:
-    Buffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memUsage);
+    Buffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage, VmaMemoryUsage memUsage, VmaAllocationCreateFlags allocFlags = 0);
     virtual ~Buffer();
     Accessor map(uint64_t offset, uint64_t size);
     const vk::Buffer &buffer() const;
@@ -55,6 +55,18 @@ namespace MVKE {
     virtual void unmap_buffer(void *data, uint64_t offset, uint64_t size);
   };
 
+  // Host-visible and mapped for its whole lifetime, for data rewritten
+  // every frame. Writes through data() must be flush()ed before the GPU
+  // reads them; map() flushes on unmap.
+  class PersistentBuffer : public Buffer {
+  public:
+    PersistentBuffer(MVKE::Instance &inst, uint64_t size, vk::BufferUsageFlags usage);
+    void *data() const;
+    void flush(uint64_t offset, uint64_t size);
+  protected:
+    virtual void *map_buffer(uint64_t offset, uint64_t size);
+    virtual void unmap_buffer(void *data, uint64_t offset, uint64_t size);
+  };
 
   class StagedBuffer : public HighPerformanceBuffer {
   public:
@@ -0,0 +1,128 @@
+#include "compute.hpp"
+#include "descriptor.hpp"
+#include "device.hpp"
+#include "reflect.hpp"
+#include "shader.hpp"
+
+MVKE::ComputePipeline::ComputePipeline(MVKE::Instance &inst, const std::string &shader, const MVKE::Specialization &specialization) : mInst(inst) {
+  const auto &reflection = mInst.mShaders->reflection(shader);
+
+  if (reflection.stage != vk::ShaderStageFlagBits::eCompute) {
+    throw std::runtime_error(shader + " is not a compute shader!");
+  }
+
+  mLayout = mInst.mLayouts->pipelineLayout({&reflection});
+  mLocalSize = reflection.localSize;
+
+  MVKE::ComputePipelineDesc desc;
+  desc.shader = mInst.mShaders->get(shader);
+  desc.specialization = specialization;
+  desc.layout = mLayout;
+
+  mPipeline = mInst.mPipelineCache->get(desc);
+}
+
+const vk::Pipeline &MVKE::ComputePipeline::pipeline() const { return mPipeline; }
+const vk::PipelineLayout &MVKE::ComputePipeline::layout() const { return mLayout; }
+const std::array<uint32_t, 3> &MVKE::ComputePipeline::localSize() const { return mLocalSize; }
+
+const vk::DescriptorSetLayout &MVKE::ComputePipeline::setLayout(uint32_t set) const {
+  return mInst.mLayouts->setLayouts(mLayout).at(set);
+}
+
+vk::DescriptorSet MVKE::ComputePipeline::storageSet(const std::vector<vk::DescriptorBufferInfo> &buffers, uint32_t set) const {
+  std::vector<MVKE::DescriptorBinding> bindings;
+
+  for (uint32_t i = 0; i < buffers.size(); ++i) {
+    bindings.push_back({i, vk::DescriptorType::eStorageBuffer, buffers[i], vk::DescriptorImageInfo()});
+  }
+
+  return mInst.mDescriptorCache->get(setLayout(set), bindings);
+}
+
+void MVKE::ComputePipeline::bind(const vk::CommandBuffer &cmd, const std::vector<vk::DescriptorSet> &sets) const {
+  // A shader reload may have replaced the pipeline since it was created.
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, mInst.mPipelineCache->current(mPipeline), mInst.mDevice->dispatch());
+
+  if (!sets.empty()) {
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, mLayout, 0, sets, {}, mInst.mDevice->dispatch());
+  }
+}
+
+void MVKE::ComputePipeline::push(const vk::CommandBuffer &cmd, const void *data, uint32_t size) const {
+  cmd.pushConstants(mLayout, vk::ShaderStageFlagBits::eCompute, 0, size, data, mInst.mDevice->dispatch());
+}
+
+void MVKE::ComputePipeline::dispatch(const vk::CommandBuffer &cmd, uint32_t x, uint32_t y, uint32_t z) const {
+  cmd.dispatch(x, y, z, mInst.mDevice->dispatch());
+}
+
+void MVKE::ComputePipeline::dispatchFor(const vk::CommandBuffer &cmd, uint32_t count) const {
+  cmd.dispatch((count + mLocalSize[0] - 1) / mLocalSize[0], 1, 1, mInst.mDevice->dispatch());
+}
+
+MVKE::ComputeQueue::ComputeQueue(MVKE::Instance &inst) : mInst(inst) {
+  QueueFamilies families = mInst.mDevice->findFamilies();
+
+  if (!families.compute) {
+    throw std::runtime_error("No compute queue family!");
+  }
+
+  mFamily = *families.compute;
+  mAsync = mFamily != *families.graphics;
+
+  mCommandPool = mInst.mDevice->device().createCommandPoolUnique({
+    vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    mFamily
+  });
+
+  auto cmds = mInst.mDevice->device().allocateCommandBuffersUnique({*mCommandPool, vk::CommandBufferLevel::ePrimary, MAX_CONCURRENT_FRAMES});
+
+  mFrames.resize(MAX_CONCURRENT_FRAMES);
+
+  for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; ++i) {
+    mFrames[i].cmd = std::move(cmds[i]);
+    mFrames[i].fence = mInst.mDevice->device().createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+    mFrames[i].done = mInst.mDevice->device().createSemaphoreUnique(vk::SemaphoreCreateInfo());
+  }
+}
+
+MVKE::ComputeQueue::~ComputeQueue() {
+  for (auto &f : mFrames) {
+    mInst.mDevice->device().waitForFences(*f.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+  }
+}
+
+bool MVKE::ComputeQueue::async() const { return mAsync; }
+uint32_t MVKE::ComputeQueue::family() const { return mFamily; }
+
+vk::Semaphore MVKE::ComputeQueue::submit(size_t frame, const std::function<void(const vk::CommandBuffer &)> &record) {
+  Frame &f = mFrames[frame];
+  const auto &dispatch = mInst.mDevice->dispatch();
+
+  mInst.mDevice->device().waitForFences(*f.fence, VK_TRUE, std::numeric_limits<uint64_t>::max(), dispatch);
+  mInst.mDevice->device().resetFences(*f.fence, dispatch);
+
+  f.cmd->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}, dispatch);
+  record(*f.cmd);
+  f.cmd->end(dispatch);
+
+  vk::Queue queue = mAsync ? mInst.mQueues.compute : mInst.mQueues.graphics;
+  queue.submit({{0, nullptr, nullptr, 1, &f.cmd.get(), 1, &f.done.get()}}, *f.fence, dispatch);
+
+  return *f.done;
+}
+
+void MVKE::ComputeQueue::release(const vk::CommandBuffer &cmd, const vk::Buffer &buffer, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess) {
+  if (srcFamily == dstFamily) return;
+
+  vk::BufferMemoryBarrier barrier(srcAccess, vk::AccessFlags(), srcFamily, dstFamily, buffer, 0, VK_WHOLE_SIZE);
+  cmd.pipelineBarrier(srcStage, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), {}, barrier, {});
+}
+
+void MVKE::ComputeQueue::acquire(const vk::CommandBuffer &cmd, const vk::Buffer &buffer, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess) {
+  if (srcFamily == dstFamily) return;
+
+  vk::BufferMemoryBarrier barrier(vk::AccessFlags(), dstAccess, srcFamily, dstFamily, buffer, 0, VK_WHOLE_SIZE);
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, dstStage, vk::DependencyFlags(), {}, barrier, {});
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mvke.hpp"
+#include "pipeline.hpp"
+
+namespace MVKE {
+  // A compute shader with its layout reflected from the SPIR-V. Storage
+  // buffers are bound by binding index through storageSet().
+  class ComputePipeline {
+  public:
+    ComputePipeline(MVKE::Instance &inst, const std::string &shader, const MVKE::Specialization &specialization = MVKE::Specialization());
+
+    const vk::Pipeline &pipeline() const;
+    const vk::PipelineLayout &layout() const;
+    const vk::DescriptorSetLayout &setLayout(uint32_t set) const;
+    const std::array<uint32_t, 3> &localSize() const;
+
+    // buffers[i] goes to binding i of the given set.
+    vk::DescriptorSet storageSet(const std::vector<vk::DescriptorBufferInfo> &buffers, uint32_t set = 0) const;
+
+    void bind(const vk::CommandBuffer &cmd, const std::vector<vk::DescriptorSet> &sets = {}) const;
+    void push(const vk::CommandBuffer &cmd, const void *data, uint32_t size) const;
+    void dispatch(const vk::CommandBuffer &cmd, uint32_t x, uint32_t y = 1, uint32_t z = 1) const;
+    // Enough workgroups to cover count invocations along x.
+    void dispatchFor(const vk::CommandBuffer &cmd, uint32_t count) const;
+  private:
+    MVKE::Instance &mInst;
+
+    vk::PipelineLayout mLayout;
+    vk::Pipeline mPipeline;
+    std::array<uint32_t, 3> mLocalSize;
+  };
+
+  // Submits work to the compute queue family, one command buffer per frame
+  // in flight. Each submission signals a semaphore which the graphics
+  // submission consuming the results waits on. Without a dedicated family
+  // the work lands on the graphics queue and the semaphore merely orders it.
+  class ComputeQueue {
+  public:
+    ComputeQueue(MVKE::Instance &inst);
+    ~ComputeQueue();
+
+    bool async() const;
+    uint32_t family() const;
+
+    // The returned semaphore must be waited on (see Instance::mFrameWaits)
+    // before this frame slot submits again.
+    vk::Semaphore submit(size_t frame, const std::function<void(const vk::CommandBuffer &)> &record);
+
+    // Queue family ownership transfer of an exclusive buffer, recorded as
+    // the release on the source queue and the acquire on the destination.
+    // Both are no-ops when the families are the same.
+    static void release(const vk::CommandBuffer &cmd, const vk::Buffer &buffer, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags srcStage, vk::AccessFlags srcAccess);
+    static void acquire(const vk::CommandBuffer &cmd, const vk::Buffer &buffer, uint32_t srcFamily, uint32_t dstFamily, vk::PipelineStageFlags dstStage, vk::AccessFlags dstAccess);
+  private:
+    struct Frame {
+      vk::UniqueCommandBuffer cmd;
+      vk::UniqueFence fence;
+      vk::UniqueSemaphore done;
+    };
+
+    MVKE::Instance &mInst;
+
+    uint32_t mFamily;
+    bool mAsync;
+
+    vk::UniqueCommandPool mCommandPool;
+    std::vector<Frame> mFrames;
+  };
+}
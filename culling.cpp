@@ -0,0 +1,183 @@
+#include "culling.hpp"
+#include "buffer.hpp"
+#include "compute.hpp"
+#include "device.hpp"
+
+#include <glm/gtc/matrix_access.hpp>
+#include <cstring>
+
+std::vector<MVKE::DeviceFeature> MVKE::GpuCuller::deviceFeatures() {
+  return {
+    MVKE::DeviceFeature::extension("draw indirect count", VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, &MVKE::Capabilities::drawIndirectCount),
+    MVKE::DeviceFeature::core("multi-draw indirect", &vk::PhysicalDeviceFeatures::multiDrawIndirect, &MVKE::Capabilities::multiDrawIndirect),
+    MVKE::DeviceFeature::core("indirect first instance", &vk::PhysicalDeviceFeatures::drawIndirectFirstInstance, &MVKE::Capabilities::drawIndirectFirstInstance),
+  };
+}
+
+MVKE::GpuCuller::GpuCuller(MVKE::Instance &inst, const std::vector<MVKE::CullObject> &objects, uint32_t slots) : mInst(inst), mObjectCount(objects.size()) {
+  if (objects.empty()) {
+    throw std::runtime_error("Nothing to cull!");
+  }
+
+  uint64_t objectsSize = objects.size() * sizeof objects[0];
+
+  mObjects = std::make_shared<MVKE::StagedBuffer>(mInst, objectsSize, vk::BufferUsageFlagBits::eStorageBuffer);
+  memcpy(mObjects->map(0, objectsSize), objects.data(), objectsSize);
+
+  uint32_t graphics = *mInst.mDevice->findFamilies().graphics;
+
+  mInst.submitOneTime([&](const vk::CommandBuffer &cmd) {
+    MVKE::ComputeQueue::release(cmd, mObjects->buffer(), graphics, mInst.mCompute->family(), vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+  });
+
+  MVKE::Specialization specialization;
+  specialization.set(0, mInst.mDevice->capabilities().drawIndirectFirstInstance);
+
+  mPipeline = std::make_shared<MVKE::ComputePipeline>(mInst, "cull.comp", specialization);
+
+  resize(slots);
+}
+
+void MVKE::GpuCuller::resize(uint32_t slots) {
+  using BU = vk::BufferUsageFlagBits;
+  uint64_t drawsSize = mObjectCount * sizeof(vk::DrawIndexedIndirectCommand);
+
+  mSlots.clear();
+
+  // The sets live exactly as long as the buffers they point at.
+  vk::DescriptorPoolSize size(vk::DescriptorType::eStorageBuffer, 3 * slots);
+  mPool = mInst.mDevice->device().createDescriptorPoolUnique({vk::DescriptorPoolCreateFlags(), slots, 1, &size});
+
+  std::vector<vk::DescriptorSetLayout> layouts(slots, mPipeline->setLayout(0));
+  auto sets = mInst.mDevice->device().allocateDescriptorSets({*mPool, slots, layouts.data()});
+
+  for (uint32_t i = 0; i < slots; ++i) {
+    Slot slot;
+    slot.draws = std::make_shared<MVKE::HighPerformanceBuffer>(mInst, drawsSize, BU::eStorageBuffer | BU::eIndirectBuffer | BU::eTransferDst);
+    slot.count = std::make_shared<MVKE::HighPerformanceBuffer>(mInst, sizeof(uint32_t), BU::eStorageBuffer | BU::eIndirectBuffer | BU::eTransferDst);
+    slot.set = sets[i];
+
+    vk::DescriptorBufferInfo infos[] = {
+      {mObjects->buffer(), 0, VK_WHOLE_SIZE},
+      {slot.draws->buffer(), 0, VK_WHOLE_SIZE},
+      {slot.count->buffer(), 0, VK_WHOLE_SIZE},
+    };
+
+    std::vector<vk::WriteDescriptorSet> writes;
+
+    for (uint32_t b = 0; b < 3; ++b) {
+      writes.push_back({slot.set, b, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &infos[b]});
+    }
+
+    mInst.mDevice->device().updateDescriptorSets(writes, {});
+
+    mSlots.push_back(slot);
+  }
+}
+
+vk::Semaphore MVKE::GpuCuller::submit(size_t frame, size_t slot, const glm::mat4 &viewProj) {
+  using Stage = vk::PipelineStageFlagBits;
+  using AccessBit = vk::AccessFlagBits;
+
+  const Slot &s = mSlots[slot];
+  MVKE::ComputeQueue &queue = *mInst.mCompute;
+  uint32_t graphics = *mInst.mDevice->findFamilies().graphics;
+
+  bool countExt = mInst.mDevice->capabilities().drawIndirectCount;
+
+  Frustum frustum = extractFrustum(viewProj);
+  frustum.objectCount = mObjectCount;
+
+  return queue.submit(frame, [&](const vk::CommandBuffer &cmd) {
+    const auto &dispatch = mInst.mDevice->dispatch();
+
+    if (!mObjectsAcquired) {
+      MVKE::ComputeQueue::acquire(cmd, mObjects->buffer(), graphics, queue.family(), Stage::eComputeShader, AccessBit::eShaderRead);
+      mObjectsAcquired = true;
+    }
+
+    // Everything in the slot is rewritten, so it is used without acquiring
+    // it back from the graphics family: its old contents do not matter.
+    cmd.fillBuffer(s.count->buffer(), 0, VK_WHOLE_SIZE, 0, dispatch);
+
+    // Without a GPU-side count every slot is drawn, so the ones the cull
+    // pass does not fill must be empty draws.
+    if (!countExt) cmd.fillBuffer(s.draws->buffer(), 0, VK_WHOLE_SIZE, 0, dispatch);
+
+    std::vector<vk::BufferMemoryBarrier> cleared = {
+      {AccessBit::eTransferWrite, AccessBit::eShaderRead | AccessBit::eShaderWrite, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, s.count->buffer(), 0, VK_WHOLE_SIZE},
+    };
+
+    if (!countExt) {
+      cleared.push_back({AccessBit::eTransferWrite, AccessBit::eShaderWrite, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, s.draws->buffer(), 0, VK_WHOLE_SIZE});
+    }
+
+    cmd.pipelineBarrier(Stage::eTransfer, Stage::eComputeShader, vk::DependencyFlags(), {}, cleared, {}, dispatch);
+
+    mPipeline->bind(cmd, {s.set});
+    mPipeline->push(cmd, &frustum, sizeof frustum);
+    mPipeline->dispatchFor(cmd, mObjectCount);
+
+    MVKE::ComputeQueue::release(cmd, s.draws->buffer(), queue.family(), graphics, Stage::eComputeShader, AccessBit::eShaderWrite);
+    MVKE::ComputeQueue::release(cmd, s.count->buffer(), queue.family(), graphics, Stage::eComputeShader, AccessBit::eShaderWrite);
+  });
+}
+
+std::pair<MVKE::RenderGraph::ResourceId, MVKE::RenderGraph::ResourceId> MVKE::GpuCuller::addPasses(MVKE::RenderGraph &graph, size_t slot) const {
+  const Slot &s = mSlots[slot];
+
+  // The submission waits on submit()'s semaphore, which orders the cull
+  // before the draws, so the graph needs no barrier of its own.
+  auto draws = graph.importBuffer("cull draws", s.draws->buffer(), s.draws->size());
+  auto count = graph.importBuffer("cull count", s.count->buffer(), s.count->size());
+
+  if (mInst.mCompute->async()) {
+    graph.addPass("cull acquire", [](MVKE::RenderGraph::PassBuilder &pass) {
+      pass.sideEffect();
+    }, [this, slot](const vk::CommandBuffer &cmd) {
+      const Slot &s = mSlots[slot];
+      uint32_t graphics = *mInst.mDevice->findFamilies().graphics;
+      uint32_t compute = mInst.mCompute->family();
+
+      MVKE::ComputeQueue::acquire(cmd, s.draws->buffer(), compute, graphics, vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead);
+      MVKE::ComputeQueue::acquire(cmd, s.count->buffer(), compute, graphics, vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead);
+    });
+  }
+
+  return {draws, count};
+}
+
+void MVKE::GpuCuller::draw(const vk::CommandBuffer &cmd, size_t slot) const {
+  const auto &dispatch = mInst.mDevice->dispatch();
+  const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+  const Slot &s = mSlots[slot];
+
+  if (mInst.mDevice->capabilities().drawIndirectCount) {
+    cmd.drawIndexedIndirectCountKHR(s.draws->buffer(), 0, s.count->buffer(), 0, mObjectCount, stride, dispatch);
+  } else if (mInst.mDevice->capabilities().multiDrawIndirect) {
+    cmd.drawIndexedIndirect(s.draws->buffer(), 0, mObjectCount, stride, dispatch);
+  } else {
+    for (uint32_t i = 0; i < mObjectCount; ++i) {
+      cmd.drawIndexedIndirect(s.draws->buffer(), i * stride, 1, stride, dispatch);
+    }
+  }
+}
+
+// Gribb-Hartmann plane extraction for a 0..1 depth range. Planes point
+// inwards and are normalised so the shader can compare against the radius.
+MVKE::GpuCuller::Frustum MVKE::GpuCuller::extractFrustum(const glm::mat4 &viewProj) {
+  glm::vec4 r0 = glm::row(viewProj, 0);
+  glm::vec4 r1 = glm::row(viewProj, 1);
+  glm::vec4 r2 = glm::row(viewProj, 2);
+  glm::vec4 r3 = glm::row(viewProj, 3);
+
+  Frustum f = {{r3 + r0, r3 - r0, r3 + r1, r3 - r1, r2, r3 - r2}, 0};
+
+  for (auto &p : f.planes) {
+    p /= glm::length(glm::vec3(p));
+  }
+
+  return f;
+}
+
+uint32_t MVKE::GpuCuller::objectCount() const { return mObjectCount; }
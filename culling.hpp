@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mvke.hpp"
+#include "rendergraph.hpp"
+
+namespace MVKE {
+  // Matches Object in shaders/cull.comp.
+  struct CullObject {
+    // xyz centre, w radius.
+    glm::vec4 sphere;
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t vertexOffset;
+    uint32_t pad = 0;
+  };
+
+  // Frustum culling on the GPU. A compute pass tests every object's bounding
+  // sphere and appends the visible ones as indexed indirect draws, counted
+  // with an atomic; the graphics pass then draws them without the CPU ever
+  // seeing the result, so its cost does not grow with the object count.
+  //
+  // Each swapchain image has its own draw and count buffers. The cull runs
+  // on the compute queue, so with a dedicated compute family it overlaps
+  // the previous frame's rendering; the buffers are then released to the
+  // graphics family and acquired again by addPasses().
+  class GpuCuller {
+  public:
+    GpuCuller(MVKE::Instance &inst, const std::vector<MVKE::CullObject> &objects, uint32_t slots);
+
+    // A GPU-side draw count, else multi-draw indirect, else one indirect
+    // draw per object. Draws start at the object's index as their instance
+    // only with indirect first instance, and at 0 without it.
+    static std::vector<MVKE::DeviceFeature> deviceFeatures();
+
+    // Culls into the slot's buffers and returns the semaphore that the
+    // graphics submission drawing them must wait on at the draw indirect
+    // stage. The slot must not be in use by the GPU.
+    vk::Semaphore submit(size_t frame, size_t slot, const glm::mat4 &viewProj);
+
+    // Imports the slot's draw and count buffers, which the drawing pass must
+    // read with Access::eIndirect, and acquires them from the compute family.
+    std::pair<MVKE::RenderGraph::ResourceId, MVKE::RenderGraph::ResourceId> addPasses(MVKE::RenderGraph &graph, size_t slot) const;
+
+    // Draws whatever survived culling with the bound pipeline and buffers.
+    void draw(const vk::CommandBuffer &cmd, size_t slot) const;
+
+    // Replaces the per-slot buffers; none may be in use by the GPU.
+    void resize(uint32_t slots);
+
+    uint32_t objectCount() const;
+  private:
+    struct Frustum {
+      glm::vec4 planes[6];
+      uint32_t objectCount;
+    };
+
+    struct Slot {
+      std::shared_ptr<MVKE::Buffer> draws;
+      std::shared_ptr<MVKE::Buffer> count;
+      vk::DescriptorSet set;
+    };
+
+    static Frustum extractFrustum(const glm::mat4 &viewProj);
+
+    MVKE::Instance &mInst;
+
+    uint32_t mObjectCount;
+
+    std::shared_ptr<MVKE::Buffer> mObjects;
+    // Uploaded on the graphics queue; the first cull acquires it.
+    bool mObjectsAcquired = false;
+
+    std::shared_ptr<MVKE::ComputePipeline> mPipeline;
+    vk::UniqueDescriptorPool mPool;
+    std::vector<Slot> mSlots;
+  };
+}
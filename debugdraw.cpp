@@ -0,0 +1,227 @@
+#include "debugdraw.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+#include "pipeline.hpp"
+#include "reflect.hpp"
+#include "shader.hpp"
+
+#include <cmath>
+#include <cstring>
+
+MVKE::DebugDraw::DebugDraw(MVKE::Instance &inst, const vk::RenderPass &renderPass, uint32_t subpass, vk::SampleCountFlagBits samples, uint32_t maxLines, uint32_t slots)
+: mInst(inst), mMaxLines(maxLines), mSlots(slots) {
+  const auto &vertReflection = mInst.mShaders->reflection("debug.vert");
+  const auto &fragReflection = mInst.mShaders->reflection("debug.frag");
+
+  if (vertReflection.inputs.size() != DebugVertex::getAttributeDescriptions().size()) {
+    throw std::runtime_error("Debug shader inputs do not match MVKE::DebugVertex!");
+  }
+
+  mLayout = mInst.mLayouts->pipelineLayout({&vertReflection, &fragReflection});
+
+  auto attributes = DebugVertex::getAttributeDescriptions();
+
+  // Lines are tested against the scene but never occlude it, so they work
+  // in the colour subpass whether or not there was a depth prepass.
+  MVKE::PipelineDesc desc;
+  desc.vertShader = mInst.mShaders->get("debug.vert");
+  desc.fragShader = mInst.mShaders->get("debug.frag");
+  desc.bindings = {DebugVertex::getBindingDescription()};
+  desc.attributes.assign(attributes.begin(), attributes.end());
+  desc.topology = vk::PrimitiveTopology::eLineList;
+  desc.cullMode = vk::CullModeFlagBits::eNone;
+  desc.samples = samples;
+  desc.depthTest = true;
+  desc.depthCompare = vk::CompareOp::eLessOrEqual;
+  desc.blendEnable = true;
+  desc.srcColorBlend = vk::BlendFactor::eSrcAlpha;
+  desc.dstColorBlend = vk::BlendFactor::eOneMinusSrcAlpha;
+  desc.dstAlphaBlend = vk::BlendFactor::eOneMinusSrcAlpha;
+  desc.layout = mLayout;
+  desc.renderPass = renderPass;
+  desc.subpass = subpass;
+
+  mDepthPipeline = mInst.mPipelineCache->get(desc);
+
+  desc.depthTest = false;
+
+  mOverlayPipeline = mInst.mPipelineCache->get(desc);
+
+  // Two draw commands per slot, then the arenas.
+  vk::DeviceSize headerSize = slots * 2 * sizeof (vk::DrawIndirectCommand);
+  mVertexOffset = (headerSize + 15) & ~15;
+
+  mBuffer = std::make_shared<MVKE::PersistentBuffer>(mInst, mVertexOffset + (slots + 1) * maxLines * 2 * sizeof (DebugVertex), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+
+  mSlotArenas.resize(slots);
+
+  // Until a slot is first published it draws nothing from its own arena.
+  for (uint32_t i = 0; i < slots; ++i) {
+    mSlotArenas[i] = i;
+
+    std::array<vk::DrawIndirectCommand, 2> draws = {
+      vk::DrawIndirectCommand(0, 1, i * maxLines * 2, 0),
+      vk::DrawIndirectCommand(0, 1, i * maxLines * 2, 0),
+    };
+
+    memcpy(static_cast<char *>(mBuffer->data()) + headerOffset(i), draws.data(), sizeof draws);
+  }
+
+  mFilling = slots;
+
+  mBuffer->flush(0, VK_WHOLE_SIZE);
+}
+
+void MVKE::DebugDraw::setTransform(const glm::mat4 &transform) {
+  mTransform = transform;
+}
+
+void MVKE::DebugDraw::line(glm::vec3 a, glm::vec3 b, uint32_t color, bool depthTest) {
+  DebugVertex *v = reserve(1, depthTest);
+
+  v[0] = {mTransform * glm::vec4(a, 1.0f), color};
+  v[1] = {mTransform * glm::vec4(b, 1.0f), color};
+}
+
+void MVKE::DebugDraw::box(glm::vec3 min, glm::vec3 max, uint32_t color, bool depthTest) {
+  std::array<glm::vec4, 8> corners;
+
+  for (uint32_t i = 0; i < 8; ++i) {
+    glm::vec3 c(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z);
+    corners[i] = mTransform * glm::vec4(c, 1.0f);
+  }
+
+  edges(corners, color, depthTest);
+}
+
+void MVKE::DebugDraw::box(const glm::mat4 &transform, uint32_t color, bool depthTest) {
+  glm::mat4 m = mTransform * transform;
+  std::array<glm::vec4, 8> corners;
+
+  for (uint32_t i = 0; i < 8; ++i) {
+    corners[i] = m * glm::vec4(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+  }
+
+  edges(corners, color, depthTest);
+}
+
+void MVKE::DebugDraw::circle(glm::vec3 center, glm::vec3 normal, float radius, uint32_t color, bool depthTest, uint32_t segments) {
+  if (segments < 3) segments = 3;
+
+  // Any two axes perpendicular to the normal span the circle's plane.
+  glm::vec3 n = glm::normalize(normal);
+  glm::vec3 u = glm::normalize(glm::cross(n, std::abs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f)));
+  glm::vec3 w = glm::cross(n, u);
+
+  DebugVertex *v = reserve(segments, depthTest);
+  glm::vec4 prev = mTransform * glm::vec4(center + radius * u, 1.0f);
+
+  for (uint32_t s = 1; s <= segments; ++s) {
+    float angle = 2.0f * static_cast<float>(M_PI) * s / segments;
+    glm::vec4 next = mTransform * glm::vec4(center + radius * (std::cos(angle) * u + std::sin(angle) * w), 1.0f);
+
+    *v++ = {prev, color};
+    *v++ = {next, color};
+    prev = next;
+  }
+}
+
+void MVKE::DebugDraw::sphere(glm::vec3 center, float radius, uint32_t color, bool depthTest, uint32_t segments) {
+  circle(center, glm::vec3(1.0f, 0.0f, 0.0f), radius, color, depthTest, segments);
+  circle(center, glm::vec3(0.0f, 1.0f, 0.0f), radius, color, depthTest, segments);
+  circle(center, glm::vec3(0.0f, 0.0f, 1.0f), radius, color, depthTest, segments);
+}
+
+void MVKE::DebugDraw::publish(size_t slot) {
+  if (slot >= mSlots) throw std::runtime_error("Debug draw slot out of range!");
+
+  uint32_t filled = mFilling;
+  mFilling = mSlotArenas[slot];
+  mSlotArenas[slot] = filled;
+
+  uint32_t first = filled * mMaxLines * 2;
+  uint32_t overlayFirst = first + (mMaxLines - mOverlayLines) * 2;
+
+  std::array<vk::DrawIndirectCommand, 2> draws = {
+    vk::DrawIndirectCommand(mLines * 2, 1, first, 0),
+    vk::DrawIndirectCommand(mOverlayLines * 2, 1, overlayFirst, 0),
+  };
+
+  if (mLines) mBuffer->flush(mVertexOffset + first * sizeof (DebugVertex), mLines * 2 * sizeof (DebugVertex));
+  if (mOverlayLines) mBuffer->flush(mVertexOffset + overlayFirst * sizeof (DebugVertex), mOverlayLines * 2 * sizeof (DebugVertex));
+
+  memcpy(static_cast<char *>(mBuffer->data()) + headerOffset(slot), draws.data(), sizeof draws);
+  mBuffer->flush(headerOffset(slot), sizeof draws);
+
+  mStats.lines = mLines;
+  mStats.overlayLines = mOverlayLines;
+
+  mLines = 0;
+  mOverlayLines = 0;
+}
+
+void MVKE::DebugDraw::record(const vk::CommandBuffer &cmd, size_t slot) const {
+  const auto &dispatch = mInst.mDevice->dispatch();
+
+  cmd.bindVertexBuffers(0, {mBuffer->buffer()}, {mVertexOffset}, dispatch);
+
+  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mDepthPipeline, dispatch);
+  cmd.drawIndirect(mBuffer->buffer(), headerOffset(slot), 1, sizeof (vk::DrawIndirectCommand), dispatch);
+
+  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mOverlayPipeline, dispatch);
+  cmd.drawIndirect(mBuffer->buffer(), headerOffset(slot) + sizeof (vk::DrawIndirectCommand), 1, sizeof (vk::DrawIndirectCommand), dispatch);
+}
+
+bool MVKE::DebugDraw::replace(const vk::Pipeline &from, const vk::Pipeline &to) {
+  bool replaced = false;
+
+  for (vk::Pipeline *p : {&mDepthPipeline, &mOverlayPipeline}) {
+    if (*p != from) continue;
+    *p = to;
+    replaced = true;
+  }
+
+  return replaced;
+}
+
+// Depth-tested lines grow up from the start of the arena and overlay lines
+// down from its end, so each kind stays contiguous for its one draw.
+MVKE::DebugVertex *MVKE::DebugDraw::reserve(uint32_t lines, bool depthTest) {
+  if (mLines + mOverlayLines + lines > mMaxLines) {
+    throw std::runtime_error("Debug draw buffer full!");
+  }
+
+  if (depthTest) {
+    DebugVertex *v = arena(mFilling) + mLines * 2;
+    mLines += lines;
+    return v;
+  }
+
+  mOverlayLines += lines;
+  return arena(mFilling) + (mMaxLines - mOverlayLines) * 2;
+}
+
+// The twelve edges join corners whose indices differ in one bit.
+void MVKE::DebugDraw::edges(const std::array<glm::vec4, 8> &corners, uint32_t color, bool depthTest) {
+  DebugVertex *v = reserve(12, depthTest);
+
+  for (uint32_t i = 0; i < 8; ++i) {
+    for (uint32_t bit = 1; bit < 8; bit <<= 1) {
+      if (i & bit) continue;
+
+      *v++ = {corners[i], color};
+      *v++ = {corners[i | bit], color};
+    }
+  }
+}
+
+vk::DeviceSize MVKE::DebugDraw::headerOffset(size_t slot) const {
+  return slot * 2 * sizeof (vk::DrawIndirectCommand);
+}
+
+MVKE::DebugVertex *MVKE::DebugDraw::arena(uint32_t index) const {
+  return reinterpret_cast<MVKE::DebugVertex *>(static_cast<char *>(mBuffer->data()) + mVertexOffset) + index * mMaxLines * 2;
+}
+
+uint32_t MVKE::DebugDraw::capacity() const { return mMaxLines; }
+const MVKE::DebugDraw::Stats &MVKE::DebugDraw::stats() const { return mStats; }
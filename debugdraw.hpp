@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // Immediate-mode lines, boxes and circles for diagnostics. Each call
+  // appends straight into a linear arena of one persistently mapped buffer,
+  // depth-tested lines from the front and overlay lines from the back, so
+  // everything is drawn with two indirect draws and nothing is allocated
+  // per frame.
+  //
+  // There is one arena per slot (one per swapchain image, matching the
+  // pre-recorded command buffers) plus the one being filled. publish()
+  // points the slot's draws at the filled arena and takes back the arena
+  // the slot drew last time, which is free once the slot's fence has
+  // signalled.
+  class DebugDraw {
+  public:
+    struct Stats {
+      uint32_t lines = 0;
+      uint32_t overlayLines = 0;
+    };
+
+    DebugDraw(MVKE::Instance &inst, const vk::RenderPass &renderPass, uint32_t subpass, vk::SampleCountFlagBits samples, uint32_t maxLines, uint32_t slots);
+
+    // World to clip space, applied to every point added after it.
+    void setTransform(const glm::mat4 &transform);
+
+    // Colours are RGBA8 with red in the low byte. Overlay lines, with
+    // depthTest false, are drawn on top of everything.
+    void line(glm::vec3 a, glm::vec3 b, uint32_t color = 0xffffffff, bool depthTest = true);
+    void box(glm::vec3 min, glm::vec3 max, uint32_t color = 0xffffffff, bool depthTest = true);
+    // The cube from -1 to 1 under transform.
+    void box(const glm::mat4 &transform, uint32_t color = 0xffffffff, bool depthTest = true);
+    void circle(glm::vec3 center, glm::vec3 normal, float radius, uint32_t color = 0xffffffff, bool depthTest = true, uint32_t segments = 32);
+    void sphere(glm::vec3 center, float radius, uint32_t color = 0xffffffff, bool depthTest = true, uint32_t segments = 32);
+
+    // The slot's previous frame must have finished on the GPU.
+    void publish(size_t slot);
+    void record(const vk::CommandBuffer &cmd, size_t slot) const;
+    // After a shader reload; the command buffers must be recorded again.
+    bool replace(const vk::Pipeline &from, const vk::Pipeline &to);
+
+    uint32_t capacity() const;
+    // Of the last published frame.
+    const Stats &stats() const;
+  private:
+    MVKE::DebugVertex *reserve(uint32_t lines, bool depthTest);
+    void edges(const std::array<glm::vec4, 8> &corners, uint32_t color, bool depthTest);
+
+    vk::DeviceSize headerOffset(size_t slot) const;
+    MVKE::DebugVertex *arena(uint32_t index) const;
+
+    MVKE::Instance &mInst;
+
+    uint32_t mMaxLines;
+    uint32_t mSlots;
+
+    vk::PipelineLayout mLayout;
+    vk::Pipeline mDepthPipeline;
+    vk::Pipeline mOverlayPipeline;
+
+    vk::DeviceSize mVertexOffset;
+    std::shared_ptr<MVKE::PersistentBuffer> mBuffer;
+
+    // The arena each slot draws from.
+    std::vector<uint32_t> mSlotArenas;
+    uint32_t mFilling;
+
+    glm::mat4 mTransform = glm::mat4(1.0f);
+    uint32_t mLines = 0;
+    uint32_t mOverlayLines = 0;
+
+    Stats mStats;
+  };
+}
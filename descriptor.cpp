@@ -0,0 +1,159 @@
+#include "descriptor.hpp"
+#include "device.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+MVKE::DescriptorPoolProfile MVKE::DescriptorPoolProfile::defaults() {
+  return {
+    256,
+    {
+      {vk::DescriptorType::eSampler, 0.5f},
+      {vk::DescriptorType::eCombinedImageSampler, 4.0f},
+      {vk::DescriptorType::eSampledImage, 4.0f},
+      {vk::DescriptorType::eStorageImage, 1.0f},
+      {vk::DescriptorType::eUniformBuffer, 2.0f},
+      {vk::DescriptorType::eStorageBuffer, 2.0f},
+      {vk::DescriptorType::eUniformBufferDynamic, 1.0f},
+      {vk::DescriptorType::eStorageBufferDynamic, 1.0f},
+    }
+  };
+}
+
+MVKE::DescriptorAllocator::DescriptorAllocator(MVKE::Instance &inst, MVKE::DescriptorPoolProfile profile) : mInst(inst), mProfile(profile) {}
+
+vk::DescriptorPool MVKE::DescriptorAllocator::grabPool() {
+  if (!mFreePools.empty()) {
+    mUsedPools.push_back(std::move(mFreePools.back()));
+    mFreePools.pop_back();
+    return *mUsedPools.back();
+  }
+
+  std::vector<vk::DescriptorPoolSize> sizes;
+  sizes.reserve(mProfile.ratios.size());
+
+  for (const auto &r : mProfile.ratios) {
+    sizes.push_back({r.first, std::max(1u, static_cast<uint32_t>(r.second * mProfile.setsPerPool))});
+  }
+
+  mUsedPools.push_back(mInst.mDevice->device().createDescriptorPoolUnique({
+    vk::DescriptorPoolCreateFlags(),
+    mProfile.setsPerPool,
+    static_cast<uint32_t>(sizes.size()),
+    sizes.data()
+  }));
+
+  ++mStats.poolsCreated;
+  std::cout << "Descriptor allocator grew to " << mStats.poolsCreated << " pools" << std::endl;
+
+  return *mUsedPools.back();
+}
+
+vk::DescriptorSet MVKE::DescriptorAllocator::allocate(const vk::DescriptorSetLayout &layout) {
+  if (!mCurrent) {
+    mCurrent = grabPool();
+  }
+
+  ++mStats.allocations;
+
+  try {
+    return mInst.mDevice->device().allocateDescriptorSets({mCurrent, 1, &layout})[0];
+  } catch (vk::OutOfPoolMemoryError &e) {
+  } catch (vk::FragmentedPoolError &e) {
+  }
+
+  // The current pool is exhausted; move on to a fresh one. A failure here
+  // means the layout cannot fit in a pool of this profile at all.
+  mCurrent = grabPool();
+  return mInst.mDevice->device().allocateDescriptorSets({mCurrent, 1, &layout})[0];
+}
+
+void MVKE::DescriptorAllocator::reset() {
+  for (auto &pool : mUsedPools) {
+    mInst.mDevice->device().resetDescriptorPool(*pool);
+    mFreePools.push_back(std::move(pool));
+  }
+
+  mUsedPools.clear();
+  mCurrent = vk::DescriptorPool();
+
+  ++mStats.resets;
+}
+
+const MVKE::DescriptorAllocator::Stats &MVKE::DescriptorAllocator::stats() const { return mStats; }
+
+bool MVKE::DescriptorBinding::operator==(const MVKE::DescriptorBinding &other) const {
+  return binding == other.binding && type == other.type && buffer == other.buffer && image == other.image;
+}
+
+bool MVKE::DescriptorSetCache::Key::operator==(const MVKE::DescriptorSetCache::Key &other) const {
+  return layout == other.layout && bindings == other.bindings;
+}
+
+size_t MVKE::DescriptorSetCache::KeyHash::operator()(const MVKE::DescriptorSetCache::Key &key) const {
+  size_t seed = 0;
+
+  MVKE::hashCombine(seed, static_cast<VkDescriptorSetLayout>(key.layout));
+
+  for (const auto &b : key.bindings) {
+    MVKE::hashCombine(seed, b.binding);
+    MVKE::hashCombine(seed, static_cast<uint32_t>(b.type));
+    MVKE::hashCombine(seed, static_cast<VkBuffer>(b.buffer.buffer));
+    MVKE::hashCombine(seed, b.buffer.offset);
+    MVKE::hashCombine(seed, b.buffer.range);
+    MVKE::hashCombine(seed, static_cast<VkSampler>(b.image.sampler));
+    MVKE::hashCombine(seed, static_cast<VkImageView>(b.image.imageView));
+    MVKE::hashCombine(seed, static_cast<uint32_t>(b.image.imageLayout));
+  }
+
+  return seed;
+}
+
+MVKE::DescriptorSetCache::DescriptorSetCache(MVKE::Instance &inst, MVKE::DescriptorAllocator &allocator) : mInst(inst), mAllocator(allocator) {}
+
+vk::DescriptorSet MVKE::DescriptorSetCache::get(const vk::DescriptorSetLayout &layout, const std::vector<MVKE::DescriptorBinding> &bindings) {
+  Key key{layout, bindings};
+
+  auto it = mSets.find(key);
+  if (it != mSets.end()) {
+    ++mStats.hits;
+    return it->second;
+  }
+
+  ++mStats.misses;
+
+  vk::DescriptorSet set = mAllocator.allocate(layout);
+
+  std::vector<vk::WriteDescriptorSet> writes;
+  writes.reserve(bindings.size());
+
+  for (const auto &b : bindings) {
+    vk::WriteDescriptorSet write(set, b.binding, 0, 1, b.type);
+
+    switch (b.type) {
+    case vk::DescriptorType::eUniformBuffer:
+    case vk::DescriptorType::eStorageBuffer:
+    case vk::DescriptorType::eUniformBufferDynamic:
+    case vk::DescriptorType::eStorageBufferDynamic:
+      write.pBufferInfo = &b.buffer;
+      break;
+    default:
+      write.pImageInfo = &b.image;
+      break;
+    }
+
+    writes.push_back(write);
+  }
+
+  mInst.mDevice->device().updateDescriptorSets(writes, {});
+
+  mSets.emplace(std::move(key), set);
+  return set;
+}
+
+void MVKE::DescriptorSetCache::clear() {
+  mSets.clear();
+}
+
+const MVKE::DescriptorSetCache::Stats &MVKE::DescriptorSetCache::stats() const { return mStats; }
\ No newline at end of file
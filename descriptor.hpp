@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // How many descriptors of each type a pool holds, relative to its set count.
+  struct DescriptorPoolProfile {
+    uint32_t setsPerPool;
+    std::vector<std::pair<vk::DescriptorType, float>> ratios;
+
+    static DescriptorPoolProfile defaults();
+  };
+
+  class DescriptorAllocator {
+  public:
+    struct Stats {
+      uint64_t poolsCreated = 0;
+      uint64_t resets = 0;
+      uint64_t allocations = 0;
+    };
+
+    DescriptorAllocator(MVKE::Instance &inst, MVKE::DescriptorPoolProfile profile = DescriptorPoolProfile::defaults());
+    vk::DescriptorSet allocate(const vk::DescriptorSetLayout &layout);
+    void reset();
+
+    const Stats &stats() const;
+  private:
+    vk::DescriptorPool grabPool();
+
+    MVKE::Instance &mInst;
+    MVKE::DescriptorPoolProfile mProfile;
+
+    std::vector<vk::UniqueDescriptorPool> mUsedPools;
+    std::vector<vk::UniqueDescriptorPool> mFreePools;
+    vk::DescriptorPool mCurrent;
+
+    Stats mStats;
+  };
+
+  struct DescriptorBinding {
+    uint32_t binding;
+    vk::DescriptorType type;
+    vk::DescriptorBufferInfo buffer;
+    vk::DescriptorImageInfo image;
+
+    bool operator==(const DescriptorBinding &other) const;
+  };
+
+  // Sets are keyed on raw handles and never evicted, so a buffer or view
+  // destroyed while cached can alias a later one with the same handle.
+  // Only cache bindings to resources that live as long as the cache, or
+  // clear() it once they are gone.
+  class DescriptorSetCache {
+  public:
+    struct Stats {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+    };
+
+    DescriptorSetCache(MVKE::Instance &inst, MVKE::DescriptorAllocator &allocator);
+    vk::DescriptorSet get(const vk::DescriptorSetLayout &layout, const std::vector<MVKE::DescriptorBinding> &bindings);
+    void clear();
+
+    const Stats &stats() const;
+  private:
+    struct Key {
+      vk::DescriptorSetLayout layout;
+      std::vector<MVKE::DescriptorBinding> bindings;
+
+      bool operator==(const Key &other) const;
+    };
+
+    struct KeyHash {
+      size_t operator()(const Key &key) const;
+    };
+
+    MVKE::Instance &mInst;
+    MVKE::DescriptorAllocator &mAllocator;
+
+    std::unordered_map<Key, vk::DescriptorSet, KeyHash> mSets;
+
+    Stats mStats;
+  };
+}
\ No newline at end of file
@@ -3,6 +3,15 @@
 #include "swapchain.hpp"
 #include "pipeline.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
 #include <map>
 #include <set>
 #include <string>
@@ -10,33 +19,215 @@
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc_wrapper.hpp"
 
-const std::vector<const char *> MVKE::Device::sExtensions = {
-  VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+// Prefixed to the driver's blob so a file from another driver build, or one
+// cut short by a crash, is rejected before it ever reaches the driver.
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t dataSize;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
 };
 
-MVKE::Device::Device(MVKE::Instance &inst) : mInst(inst) {
+static const uint32_t sPipelineCacheMagic = 0x4d564b45; // "MVKE"
+
+MVKE::DeviceFeature MVKE::DeviceFeature::core(std::string name, vk::Bool32 vk::PhysicalDeviceFeatures::*feature, bool MVKE::Capabilities::*capability, bool required) {
+  MVKE::DeviceFeature f;
+  f.name = name;
+  f.required = required;
+  f.supported = [feature](const MVKE::FeatureChain &c) { return c.core.features.*feature == VK_TRUE; };
+  f.enable = [feature](MVKE::FeatureChain &c) { c.core.features.*feature = VK_TRUE; };
+  f.capability = capability;
+  return f;
+}
+
+MVKE::DeviceFeature MVKE::DeviceFeature::extension(std::string name, const char *extension, bool MVKE::Capabilities::*capability, bool required) {
+  MVKE::DeviceFeature f;
+  f.name = name;
+  f.extensions = {extension};
+  f.required = required;
+  f.capability = capability;
+  return f;
+}
+
+void MVKE::FeatureChain::link(const std::set<std::string> &extensions) {
+  void **next = &core.pNext;
+
+  auto append = [&](const char *extension, auto &features) {
+    if (!extensions.count(extension)) return;
+    *next = &features;
+    next = &features.pNext;
+  };
+
+  append(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME, descriptorIndexing);
+#ifdef VK_KHR_timeline_semaphore
+  append(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, timelineSemaphore);
+#endif
+#ifdef VK_EXT_buffer_device_address
+  append(VK_EXT_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, bufferDeviceAddress);
+#endif
+
+  *next = nullptr;
+}
+
+// Features that only exist in newer headers are left out when building
+// against older ones.
+std::vector<MVKE::DeviceFeature> MVKE::Device::commonFeatures() {
+  std::vector<MVKE::DeviceFeature> features;
+
+#ifdef VK_KHR_timeline_semaphore
+  auto timeline = DeviceFeature::extension("timeline semaphores", VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, &Capabilities::timelineSemaphores);
+  timeline.supported = [](const MVKE::FeatureChain &c) { return c.timelineSemaphore.timelineSemaphore == VK_TRUE; };
+  timeline.enable = [](MVKE::FeatureChain &c) { c.timelineSemaphore.timelineSemaphore = VK_TRUE; };
+  features.push_back(timeline);
+#endif
+
+#ifdef VK_EXT_buffer_device_address
+  auto address = DeviceFeature::extension("buffer device address", VK_EXT_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME, &Capabilities::bufferDeviceAddress);
+  address.supported = [](const MVKE::FeatureChain &c) { return c.bufferDeviceAddress.bufferDeviceAddress == VK_TRUE; };
+  address.enable = [](MVKE::FeatureChain &c) { c.bufferDeviceAddress.bufferDeviceAddress = VK_TRUE; };
+  features.push_back(address);
+#endif
+
+#ifdef VK_EXT_memory_budget
+  features.push_back(DeviceFeature::extension("memory budget", VK_EXT_MEMORY_BUDGET_EXTENSION_NAME, &Capabilities::memoryBudget));
+#endif
+
+  return features;
+}
+
+MVKE::Device::Device(MVKE::Instance &inst, std::vector<MVKE::DeviceFeature> features) : mInst(inst), mFeatures(std::move(features)) {
   auto group = chooseDeviceGroup();
   createLogicalDevice(group);
 
+  mDepthFormat = findDepthFormat();
+
   VmaAllocatorCreateInfo allocatorInfo = {};
   allocatorInfo.physicalDevice = mPhysDevice;
   allocatorInfo.device = *mDevice;
 
   vmaCreateAllocator(&allocatorInfo, &mInst.mAllocator);
+
+  const char *cachePath = std::getenv("MVKE_PIPELINE_CACHE");
+  mPipelineCachePath = cachePath ? cachePath : "mvke_pipeline.cache";
+
+  loadPipelineCache();
 }
 
 MVKE::Device::~Device() {
+  // Losing the cache only costs the next run its warm start, and throwing
+  // here would terminate.
+  try {
+    savePipelineCache();
+  } catch (std::exception &e) {
+    std::cerr << "Failed to save pipeline cache: " << e.what() << std::endl;
+  }
+
   vmaDestroyAllocator(mInst.mAllocator);
 }
 
+void MVKE::Device::loadPipelineCache() {
+  auto start = std::chrono::high_resolution_clock::now();
+  const auto &props = mProperties;
+
+  std::vector<char> data;
+  const char *reason = nullptr;
+
+  std::ifstream file(mPipelineCachePath, std::ios::ate | std::ios::binary);
+
+  if (!file.is_open()) {
+    reason = "no cache file";
+  } else {
+    size_t filesize = file.tellg();
+    PipelineCacheFileHeader header;
+
+    file.seekg(0);
+
+    if (filesize < sizeof header || !file.read(reinterpret_cast<char *>(&header), sizeof header)) {
+      reason = "truncated header";
+    } else if (header.magic != sPipelineCacheMagic || header.dataSize != filesize - sizeof header) {
+      reason = "corrupt file";
+    } else if (header.vendorID != props.vendorID || header.deviceID != props.deviceID) {
+      reason = "different device";
+    } else if (header.driverVersion != props.driverVersion || memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+      reason = "different driver";
+    } else {
+      data.resize(header.dataSize);
+      file.read(data.data(), data.size());
+    }
+  }
+
+  mPipelineCache = mDevice->createPipelineCacheUnique({
+    vk::PipelineCacheCreateFlags(),
+    data.size(),
+    data.data()
+  });
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  if (reason) {
+    std::cout << "Pipeline cache miss (" << reason << "), starting empty in " << elapsed.count() << "ms" << std::endl;
+  } else {
+    std::cout << "Pipeline cache hit, loaded " << data.size() << " bytes in " << elapsed.count() << "ms" << std::endl;
+  }
+}
+
+void MVKE::Device::savePipelineCache() const {
+  const auto &props = mProperties;
+  auto data = mDevice->getPipelineCacheData(*mPipelineCache);
+
+  PipelineCacheFileHeader header;
+  header.magic = sPipelineCacheMagic;
+  header.dataSize = data.size();
+  header.vendorID = props.vendorID;
+  header.deviceID = props.deviceID;
+  header.driverVersion = props.driverVersion;
+  memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+
+  // Write next to the real file and rename over it, so a crash mid-write
+  // never leaves a half-written cache behind.
+  std::string tmpPath = mPipelineCachePath + ".tmp";
+
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+
+    if (!file.is_open()) {
+      std::cerr << "Failed to write pipeline cache to " << tmpPath << std::endl;
+      return;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof header);
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+    if (!file) {
+      std::cerr << "Failed to write pipeline cache to " << tmpPath << std::endl;
+      return;
+    }
+  }
+
+  if (std::rename(tmpPath.c_str(), mPipelineCachePath.c_str()) != 0) {
+    std::cerr << "Failed to replace pipeline cache " << mPipelineCachePath << std::endl;
+    std::remove(tmpPath.c_str());
+  }
+}
+
 void MVKE::Device::createLogicalDevice(std::vector<vk::PhysicalDevice> group) {
   mPhysDevice = group[0];
-  auto families = findFamilies(mPhysDevice);
+  mProperties = mPhysDevice.getProperties();
+  mMemoryProperties = mPhysDevice.getMemoryProperties();
+  mFamilies = findFamilies(mPhysDevice);
+
+  const auto &families = mFamilies;
 
   auto queueInfos = std::vector<vk::DeviceQueueCreateInfo>();
 
   std::set<uint32_t> uniqueFamilies = {*families.graphics, *families.present};
 
+  if (families.compute) {
+    uniqueFamilies.insert(*families.compute);
+  }
+
   float priority = 1.0f;
 
   for (uint32_t family : uniqueFamilies) {
@@ -50,7 +241,32 @@ void MVKE::Device::createLogicalDevice(std::vector<vk::PhysicalDevice> group) {
     );
   }
 
-  vk::PhysicalDeviceFeatures features;
+  // Every supported feature is enabled, each extension once, and the core
+  // features travel in the chain rather than pEnabledFeatures.
+  auto support = negotiate(mPhysDevice);
+
+  FeatureChain enabled;
+  std::set<std::string> enabledExtensions;
+  std::vector<const char *> extensions;
+
+  for (size_t i = 0; i < mFeatures.size(); ++i) {
+    const auto &f = mFeatures[i];
+
+    if (!support[i]) {
+      if (f.required) throw std::runtime_error("Physical device lacks a required feature!");
+      std::cout << "Device feature unavailable: " << f.name << std::endl;
+      continue;
+    }
+
+    for (const char *ext : f.extensions) {
+      if (enabledExtensions.insert(ext).second) extensions.push_back(ext);
+    }
+
+    if (f.enable) f.enable(enabled);
+    if (f.capability) mCapabilities.*f.capability = true;
+  }
+
+  enabled.link(enabledExtensions);
 
   std::vector<const char *> layers;
 
@@ -66,36 +282,104 @@ void MVKE::Device::createLogicalDevice(std::vector<vk::PhysicalDevice> group) {
     queueInfos.data(),
     layers.size(),
     layers.data(),
-    sExtensions.size(),
-    sExtensions.data(),
-    &features
+    extensions.size(),
+    extensions.data(),
+    nullptr
   );
 
   vk::DeviceGroupDeviceCreateInfo deviceGroupInfo(group.size(), group.data());
 
   createInfo.pNext = &deviceGroupInfo;
+  deviceGroupInfo.pNext = &enabled.core;
 
   mDevice = group[0].createDeviceUnique(createInfo);
 
+#if (VK_HEADER_VERSION >= 99)
+  mDispatch.init(*mInst.mVkInst, vkGetInstanceProcAddr, *mDevice, vkGetDeviceProcAddr);
+#else
+  mDispatch.init(*mInst.mVkInst, *mDevice);
+#endif
+
   mInst.mQueues.graphics = mDevice->getQueue(families.graphics.value(), 0);
   mInst.mQueues.present = mDevice->getQueue(families.present.value(), 0);
+
+  if (families.compute) {
+    mInst.mQueues.compute = mDevice->getQueue(*families.compute, 0);
+  }
+}
+
+static std::string deviceUUID(const vk::PhysicalDevice &d) {
+  auto chain = d.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+  const uint8_t *uuid = chain.get<vk::PhysicalDeviceIDProperties>().deviceUUID;
+
+  std::string out;
+  char digits[3];
+
+  for (size_t i = 0; i < VK_UUID_SIZE; ++i) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) out += '-';
+    snprintf(digits, sizeof digits, "%02x", uuid[i]);
+    out += digits;
+  }
+
+  return out;
+}
+
+static std::string lowercase(std::string s) {
+  for (auto &c : s) c = std::tolower(static_cast<unsigned char>(c));
+  return s;
+}
+
+// MVKE_DEVICE pins a device by its UUID, with or without dashes, or by any
+// part of its name, ignoring case.
+static bool matchesPin(const vk::PhysicalDevice &d, const std::string &pin) {
+  std::string uuid = deviceUUID(d);
+  std::string wanted = lowercase(pin);
+  std::string bare = uuid;
+  bare.erase(std::remove(bare.begin(), bare.end(), '-'), bare.end());
+
+  return wanted == uuid || wanted == bare || lowercase(d.getProperties().deviceName).find(wanted) != std::string::npos;
 }
 
 std::vector<vk::PhysicalDevice> MVKE::Device::chooseDeviceGroup() const {
   auto groups = mInst.mVkInst->enumeratePhysicalDeviceGroups();
   std::multimap<unsigned, const vk::PhysicalDeviceGroupProperties &> candidates;
+
+  const char *pinEnv = std::getenv("MVKE_DEVICE");
+  std::string pin = pinEnv ? pinEnv : "";
+
   for (const auto &g : groups) {
     unsigned score = 0;
+    bool pinned = false;
 
     for (size_t i = 0; i < g.physicalDeviceCount; ++i) {
-      score += rateDevice(g.physicalDevices[i]);
+      const auto &d = g.physicalDevices[i];
+      auto props = d.getProperties();
+      unsigned deviceScore = rateDevice(d);
+
+      score += deviceScore;
+      pinned = pinned || (!pin.empty() && matchesPin(d, pin));
+
+      std::cout << "Device candidate: " << props.deviceName << " (" << vk::to_string(props.deviceType) << ", " << deviceUUID(d) << ") score " << deviceScore << std::endl;
+    }
+
+    if (!pin.empty()) {
+      // Unsuitable devices stay unsuitable even when pinned.
+      if (!pinned || score == 0) continue;
+      score = std::numeric_limits<unsigned>::max();
     }
 
     candidates.insert(std::make_pair(score, g));
   }
 
-  if (candidates.rbegin()->first > 0) {
+  if (!pin.empty() && candidates.empty()) {
+    throw std::runtime_error("No suitable physical device matches MVKE_DEVICE!");
+  }
+
+  if (!candidates.empty() && candidates.rbegin()->first > 0) {
     auto group = candidates.rbegin()->second;
+
+    std::cout << "Using device: " << group.physicalDevices[0].getProperties().deviceName << std::endl;
+
     return std::vector<vk::PhysicalDevice>(group.physicalDevices, group.physicalDevices + group.physicalDeviceCount);
   } else {
     throw std::runtime_error("No suitable physical devices detected!");
@@ -113,7 +397,8 @@ MVKE::QueueFamilies MVKE::Device::findFamilies(const vk::PhysicalDevice &d) cons
       found.graphics = i;
     }
 
-    if (f.queueCount > 0 && d.getSurfaceSupportKHR(i, mInst.mWindow->surface())) {
+    // Headless instances present nothing; the graphics queue stands in.
+    if (f.queueCount > 0 && (mInst.mHeadless ? found.graphics == static_cast<uint32_t>(i) : d.getSurfaceSupportKHR(i, mInst.mWindow->surface()))) {
       found.present = i;
     }
 
@@ -122,30 +407,168 @@ MVKE::QueueFamilies MVKE::Device::findFamilies(const vk::PhysicalDevice &d) cons
     ++i;
   }
 
+  for (uint32_t j = 0; j < families.size(); ++j) {
+    const auto &f = families[j];
+
+    if (f.queueCount > 0 && (f.queueFlags & vk::QueueFlagBits::eCompute) && !(f.queueFlags & vk::QueueFlagBits::eGraphics)) {
+      found.compute = j;
+      break;
+    }
+  }
+
+  if (!found.compute && found.graphics && families[*found.graphics].queueFlags & vk::QueueFlagBits::eCompute) {
+    found.compute = found.graphics;
+  }
+
   return found;
 }
 
 unsigned MVKE::Device::rateDevice(const vk::PhysicalDevice &d) const {
   if (!findFamilies(d).isComplete()) return 0;
-  if (!checkDeviceExtSupport(d)) return 0;
-  if (!MVKE::Swapchain::adequate(d, mInst)) return 0;
-  
-  return 1;
+
+  auto support = negotiate(d);
+
+  for (size_t i = 0; i < mFeatures.size(); ++i) {
+    if (mFeatures[i].required && !support[i]) return 0;
+  }
+
+  if (!mInst.mHeadless && !MVKE::Swapchain::adequate(d, mInst)) return 0;
+
+  auto props = d.getProperties();
+  auto memory = d.getMemoryProperties();
+
+  // The device type outweighs everything else, so a small discrete GPU
+  // still wins over a large integrated one.
+  unsigned score = 1;
+
+  switch (props.deviceType) {
+    case vk::PhysicalDeviceType::eDiscreteGpu: score += 400000; break;
+    case vk::PhysicalDeviceType::eIntegratedGpu: score += 300000; break;
+    case vk::PhysicalDeviceType::eVirtualGpu: score += 200000; break;
+    case vk::PhysicalDeviceType::eOther: score += 100000; break;
+    default: break;
+  }
+
+  // Then the largest device-local heap, in MiB up to 64GiB.
+  vk::DeviceSize localHeap = 0;
+
+  for (uint32_t i = 0; i < memory.memoryHeapCount; ++i) {
+    if (memory.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal) {
+      localHeap = std::max(localHeap, memory.memoryHeaps[i].size);
+    }
+  }
+
+  score += std::min<vk::DeviceSize>(localHeap >> 20, 65536);
+
+  // Then the limits and optional features the engine makes use of, each
+  // feature counted once however many subsystems asked for it.
+  score += std::min(props.limits.maxImageDimension2D, 32768u) / 1024 * 100;
+  score += std::min(props.limits.maxComputeSharedMemorySize, 65536u) / 1024 * 10;
+
+  std::set<std::string> counted;
+
+  for (size_t i = 0; i < mFeatures.size(); ++i) {
+    if (support[i] && counted.insert(mFeatures[i].name).second) score += 1000;
+  }
+
+  return score;
 }
 
-bool MVKE::Device::checkDeviceExtSupport(const vk::PhysicalDevice &d) const {
-  std::set<std::string> required(sExtensions.begin(), sExtensions.end());
-  
+std::vector<bool> MVKE::Device::negotiate(const vk::PhysicalDevice &d) const {
+  std::set<std::string> available;
+
   for (const auto &ext : d.enumerateDeviceExtensionProperties()) {
-    required.erase(ext.extensionName);
+    available.insert(ext.extensionName);
   }
 
-  return required.empty();
+  FeatureChain supported;
+  supported.link(available);
+  d.getFeatures2(&supported.core);
+
+  std::vector<bool> support;
+
+  for (const auto &f : mFeatures) {
+    bool ok = std::all_of(f.extensions.begin(), f.extensions.end(), [&](const char *ext) { return available.count(ext) > 0; });
+    support.push_back(ok && (!f.supported || f.supported(supported)));
+  }
+
+  return support;
 }
 
-MVKE::QueueFamilies MVKE::Device::findFamilies() const {
-  return findFamilies(mPhysDevice);
+const MVKE::QueueFamilies &MVKE::Device::findFamilies() const {
+  return mFamilies;
+}
+
+vk::FormatProperties MVKE::Device::formatProperties(vk::Format format) const {
+  std::lock_guard<std::mutex> lock(mFormatMutex);
+
+  auto it = mFormatProperties.find(static_cast<VkFormat>(format));
+
+  if (it == mFormatProperties.end()) {
+    it = mFormatProperties.emplace(static_cast<VkFormat>(format), mPhysDevice.getFormatProperties(format)).first;
+  }
+
+  return it->second;
+}
+
+const MVKE::SwapchainSupportDetails &MVKE::Device::surfaceSupport() {
+  vk::SurfaceKHR surface = mInst.mWindow->surface();
+
+  if (!mSurfaceFormatsValid) {
+    mSurfaceSupport.formats = mPhysDevice.getSurfaceFormatsKHR(surface);
+    mSurfaceSupport.presentModes = mPhysDevice.getSurfacePresentModesKHR(surface);
+    mSurfaceFormatsValid = true;
+  }
+
+  if (!mSurfaceCapabilitiesValid) {
+    mSurfaceSupport.capabilities = mPhysDevice.getSurfaceCapabilitiesKHR(surface);
+    mSurfaceCapabilitiesValid = true;
+  }
+
+  return mSurfaceSupport;
+}
+
+void MVKE::Device::invalidateSurfaceCapabilities() {
+  mSurfaceCapabilitiesValid = false;
 }
 
 const vk::Device &MVKE::Device::device() const { return *mDevice; }
-const vk::PhysicalDevice &MVKE::Device::physDevice() const { return mPhysDevice; }
\ No newline at end of file
+const vk::PhysicalDevice &MVKE::Device::physDevice() const { return mPhysDevice; }
+const vk::DispatchLoaderDynamic &MVKE::Device::dispatch() const { return mDispatch; }
+const vk::PhysicalDeviceProperties &MVKE::Device::properties() const { return mProperties; }
+const vk::PhysicalDeviceMemoryProperties &MVKE::Device::memoryProperties() const { return mMemoryProperties; }
+// Full-precision D32_SFLOAT first; not every device can render to it, so
+// fall back through the packed depth/stencil formats, and to D16 last.
+vk::Format MVKE::Device::findDepthFormat() const {
+  for (auto format : {vk::Format::eD32Sfloat, vk::Format::eD32SfloatS8Uint, vk::Format::eD24UnormS8Uint, vk::Format::eD16Unorm}) {
+    auto props = formatProperties(format);
+
+    if (props.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment) {
+      return format;
+    }
+  }
+
+  throw std::runtime_error("No supported depth format!");
+}
+
+// Sample counts usable for both our colour and depth attachments.
+vk::SampleCountFlags MVKE::Device::attachmentSampleCounts() const {
+  const auto &limits = mProperties.limits;
+  return limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+}
+
+// The highest supported sample count not above the one requested.
+vk::SampleCountFlagBits MVKE::Device::clampSamples(unsigned requested) const {
+  vk::SampleCountFlags counts = attachmentSampleCounts();
+
+  for (unsigned s = 64; s > 1; s >>= 1) {
+    auto bit = static_cast<vk::SampleCountFlagBits>(s);
+    if (s <= requested && (counts & bit)) return bit;
+  }
+
+  return vk::SampleCountFlagBits::e1;
+}
+
+const MVKE::Capabilities &MVKE::Device::capabilities() const { return mCapabilities; }
+vk::Format MVKE::Device::depthFormat() const { return mDepthFormat; }
+const vk::PipelineCache &MVKE::Device::pipelineCache() const { return *mPipelineCache; }
\ No newline at end of file
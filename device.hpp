@@ -1,33 +1,136 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <functional>
+#include <mutex>
 #include <vector>
 #include <optional>
+#include <set>
 #include <string>
+#include <unordered_map>
 
 #include "mvke.hpp"
+#include "swapchain.hpp"
 
 namespace MVKE {
+  // What the logical device was created with. Subsystems check these to
+  // choose their fast paths.
+  struct Capabilities {
+    bool descriptorIndexing = false;
+    bool sampledImageDynamicIndexing = false;
+    bool storageBufferDynamicIndexing = false;
+    bool drawIndirectCount = false;
+    bool multiDrawIndirect = false;
+    bool drawIndirectFirstInstance = false;
+    bool timelineSemaphores = false;
+    bool bufferDeviceAddress = false;
+    bool memoryBudget = false;
+  };
+
+  // Every feature struct the engine knows, chained through pNext. A struct
+  // is only linked when its extension is, since a device may reject structs
+  // of extensions it was not created with.
+  struct FeatureChain {
+    vk::PhysicalDeviceFeatures2 core;
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexing;
+#ifdef VK_KHR_timeline_semaphore
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timelineSemaphore;
+#endif
+#ifdef VK_EXT_buffer_device_address
+    vk::PhysicalDeviceBufferDeviceAddressFeaturesEXT bufferDeviceAddress;
+#endif
+
+    FeatureChain() = default;
+    FeatureChain(const FeatureChain &) = delete;
+    FeatureChain &operator=(const FeatureChain &) = delete;
+
+    void link(const std::set<std::string> &extensions);
+  };
+
+  // A feature a subsystem needs, or can use if present. It is supported
+  // when the device has all of its extensions and supported() (if set)
+  // accepts the queried chain. Once supported, enable() turns its bits on
+  // in the chain the device is created with, and capability is set.
+  struct DeviceFeature {
+    std::string name;
+    std::vector<const char *> extensions;
+    bool required = false;
+    std::function<bool(const MVKE::FeatureChain &)> supported;
+    std::function<void(MVKE::FeatureChain &)> enable;
+    bool MVKE::Capabilities::*capability = nullptr;
+
+    static DeviceFeature core(std::string name, vk::Bool32 vk::PhysicalDeviceFeatures::*feature, bool MVKE::Capabilities::*capability, bool required = false);
+    static DeviceFeature extension(std::string name, const char *extension, bool MVKE::Capabilities::*capability, bool required = false);
+  };
+
   class Device {
   public:
-    Device(MVKE::Instance &inst);
+    Device(MVKE::Instance &inst, std::vector<MVKE::DeviceFeature> features);
     ~Device();
-    MVKE::QueueFamilies findFamilies() const;
+    // Found once, when the device is created.
+    const MVKE::QueueFamilies &findFamilies() const;
     
     const vk::Device &device() const;
     const vk::PhysicalDevice &physDevice() const;
+    // Device-level entry points fetched straight from the driver, skipping
+    // the loader's trampolines. Pass it to per-frame calls: command
+    // recording, submission, presentation and fence waits.
+    const vk::DispatchLoaderDynamic &dispatch() const;
+
+    // Physical device queries, made once and cached.
+    const vk::PhysicalDeviceProperties &properties() const;
+    const vk::PhysicalDeviceMemoryProperties &memoryProperties() const;
+    vk::FormatProperties formatProperties(vk::Format format) const;
+
+    // Surface formats and present modes are queried once per surface; the
+    // capabilities again after invalidateSurfaceCapabilities(), since the
+    // current extent and transform follow the window.
+    const MVKE::SwapchainSupportDetails &surfaceSupport();
+    void invalidateSurfaceCapabilities();
+
+    const MVKE::Capabilities &capabilities() const;
+    vk::Format depthFormat() const;
+    vk::SampleCountFlags attachmentSampleCounts() const;
+    vk::SampleCountFlagBits clampSamples(unsigned requested) const;
+
+    const vk::PipelineCache &pipelineCache() const;
+
+    // Optional features not tied to one subsystem.
+    static std::vector<MVKE::DeviceFeature> commonFeatures();
   private:
     std::vector<vk::PhysicalDevice> chooseDeviceGroup() const;
     unsigned rateDevice(const vk::PhysicalDevice &d) const;
     void createLogicalDevice(std::vector<vk::PhysicalDevice> group);
-    bool checkDeviceExtSupport(const vk::PhysicalDevice &d) const;
+    // Which of mFeatures the device supports, by index.
+    std::vector<bool> negotiate(const vk::PhysicalDevice &d) const;
+    vk::Format findDepthFormat() const;
     MVKE::QueueFamilies findFamilies(const vk::PhysicalDevice &d) const;
+    void loadPipelineCache();
+    void savePipelineCache() const;
 
     MVKE::Instance &mInst;
 
+    std::vector<MVKE::DeviceFeature> mFeatures;
+    MVKE::Capabilities mCapabilities;
+
     vk::PhysicalDevice mPhysDevice;
     vk::UniqueDevice mDevice;
+    vk::DispatchLoaderDynamic mDispatch;
+
+    vk::PhysicalDeviceProperties mProperties;
+    vk::PhysicalDeviceMemoryProperties mMemoryProperties;
+    MVKE::QueueFamilies mFamilies;
+
+    mutable std::mutex mFormatMutex;
+    mutable std::unordered_map<VkFormat, vk::FormatProperties> mFormatProperties;
+
+    MVKE::SwapchainSupportDetails mSurfaceSupport;
+    bool mSurfaceFormatsValid = false;
+    bool mSurfaceCapabilitiesValid = false;
+
+    vk::Format mDepthFormat;
 
-    static const std::vector<const char *> sExtensions;
+    std::string mPipelineCachePath;
+    vk::UniquePipelineCache mPipelineCache;
   };
 }
\ No newline at end of file
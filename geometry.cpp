@@ -14,4 +14,45 @@ std::array<vk::VertexInputAttributeDescription, 2> MVKE::Vertex::getAttributeDes
     VIAD {0, 0, vk::Format::eR32G32Sfloat, offsetof (Vertex, pos)},
     VIAD {1, 0, vk::Format::eR32G32B32Sfloat, offsetof (Vertex, color)},
   };
+}
+
+vk::VertexInputBindingDescription MVKE::InstanceData::getBindingDescription(uint32_t binding) {
+  return {
+    binding,
+    sizeof (InstanceData),
+    vk::VertexInputRate::eInstance
+  };
+}
+
+vk::VertexInputBindingDescription MVKE::SpriteVertex::getBindingDescription() {
+  return {
+    0,
+    sizeof (SpriteVertex),
+    vk::VertexInputRate::eVertex
+  };
+}
+
+std::array<vk::VertexInputAttributeDescription, 3> MVKE::SpriteVertex::getAttributeDescriptions() {
+  using VIAD = vk::VertexInputAttributeDescription;
+  return {
+    VIAD {0, 0, vk::Format::eR32G32Sfloat, offsetof (SpriteVertex, pos)},
+    VIAD {1, 0, vk::Format::eR32G32Sfloat, offsetof (SpriteVertex, uv)},
+    VIAD {2, 0, vk::Format::eR8G8B8A8Unorm, offsetof (SpriteVertex, color)},
+  };
+}
+
+vk::VertexInputBindingDescription MVKE::DebugVertex::getBindingDescription() {
+  return {
+    0,
+    sizeof (DebugVertex),
+    vk::VertexInputRate::eVertex
+  };
+}
+
+std::array<vk::VertexInputAttributeDescription, 2> MVKE::DebugVertex::getAttributeDescriptions() {
+  using VIAD = vk::VertexInputAttributeDescription;
+  return {
+    VIAD {0, 0, vk::Format::eR32G32B32A32Sfloat, offsetof (DebugVertex, pos)},
+    VIAD {1, 0, vk::Format::eR8G8B8A8Unorm, offsetof (DebugVertex, color)},
+  };
 }
\ No newline at end of file
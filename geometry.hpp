@@ -14,6 +14,37 @@ namespace MVKE {
     static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions();
   };
 
+  // Per-instance attributes, read at instance rate from binding 1.
+  // Tightly packed to match the inputs of instanced.vert.
+  struct InstanceData {
+    glm::mat4 transform;
+    glm::vec4 color;
+    uint32_t id;
+
+    static vk::VertexInputBindingDescription getBindingDescription(uint32_t binding = 1);
+  };
+
+  // Pixel-space sprite corner with a packed RGBA8 tint, kept small since
+  // sprites are streamed every frame.
+  struct SpriteVertex {
+    glm::vec2 pos;
+    glm::vec2 uv;
+    uint32_t color;
+
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription, 3> getAttributeDescriptions();
+  };
+
+  // A clip-space line end point for debug drawing, with a packed RGBA8
+  // colour.
+  struct DebugVertex {
+    glm::vec4 pos;
+    uint32_t color;
+
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription, 2> getAttributeDescriptions();
+  };
+
   struct Triangle {
     Vertex a;
     Vertex b;
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace MVKE {
+  template <typename T>
+  inline void hashCombine(size_t &seed, const T &val) {
+    seed ^= std::hash<T>()(val) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include "hotreload.hpp"
+
+#include <stdexcept>
+
+#ifdef MVKE_HOT_RELOAD
+
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+#include <SPIRV/GlslangToSpv.h>
+
+static bool stageFor(const std::string &name, EShLanguage &stage) {
+  auto dot = name.rfind('.');
+  if (dot == std::string::npos) return false;
+
+  std::string ext = name.substr(dot + 1);
+
+  if (ext == "vert") {
+    stage = EShLangVertex;
+  } else if (ext == "frag") {
+    stage = EShLangFragment;
+  } else if (ext == "comp") {
+    stage = EShLangCompute;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+static std::vector<uint32_t> compileGLSL(const std::string &source, EShLanguage stage) {
+  const char *src = source.c_str();
+
+  glslang::TShader shader(stage);
+  shader.setStrings(&src, 1);
+  shader.setEnvInput(glslang::EShSourceGlsl, stage, glslang::EShClientVulkan, 100);
+  shader.setEnvClient(glslang::EShClientVulkan, glslang::EShTargetVulkan_1_1);
+  shader.setEnvTarget(glslang::EShTargetSpv, glslang::EShTargetSpv_1_3);
+
+  EShMessages messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules);
+
+  if (!shader.parse(GetDefaultResources(), 100, false, messages)) {
+    throw std::runtime_error(shader.getInfoLog());
+  }
+
+  glslang::TProgram program;
+  program.addShader(&shader);
+
+  if (!program.link(messages)) {
+    throw std::runtime_error(program.getInfoLog());
+  }
+
+  std::vector<uint32_t> spirv;
+  glslang::GlslangToSpv(*program.getIntermediate(stage), spirv);
+
+  return spirv;
+}
+
+MVKE::ShaderWatcher::ShaderWatcher(const std::string &dir) : mDir(dir) {
+  mInotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (mInotify < 0 || inotify_add_watch(mInotify, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    throw std::runtime_error("Failed to watch shader directory " + dir + "!");
+  }
+
+  mThread = std::thread(&MVKE::ShaderWatcher::watchLoop, this);
+}
+
+MVKE::ShaderWatcher::~ShaderWatcher() {
+  mStopping = true;
+  mThread.join();
+  close(mInotify);
+}
+
+void MVKE::ShaderWatcher::watchLoop() {
+  glslang::InitializeProcess();
+
+  alignas(inotify_event) char buf[4096];
+
+  while (!mStopping) {
+    pollfd pfd = {mInotify, POLLIN, 0};
+
+    if (::poll(&pfd, 1, 100) <= 0) continue;
+
+    // Editors tend to write a file several times in a row; compile each
+    // changed file once per wakeup.
+    std::set<std::string> changed;
+
+    ssize_t len;
+    while ((len = read(mInotify, buf, sizeof buf)) > 0) {
+      for (char *p = buf; p < buf + len;) {
+        auto *event = reinterpret_cast<inotify_event *>(p);
+        if (event->len > 0) changed.insert(event->name);
+        p += sizeof (inotify_event) + event->len;
+      }
+    }
+
+    for (const auto &name : changed) {
+      EShLanguage stage;
+      if (!stageFor(name, stage)) continue;
+
+      std::ifstream file(mDir + "/" + name);
+      std::stringstream source;
+      source << file.rdbuf();
+
+      try {
+        MVKE::CompiledShader compiled{name, compileGLSL(source.str(), stage)};
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mCompiled.push_back(std::move(compiled));
+      } catch (std::runtime_error &e) {
+        std::cerr << "Failed to compile " << name << ":" << std::endl << e.what() << std::endl;
+      }
+    }
+  }
+
+  glslang::FinalizeProcess();
+}
+
+std::vector<MVKE::CompiledShader> MVKE::ShaderWatcher::poll() {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  std::vector<MVKE::CompiledShader> compiled;
+  compiled.swap(mCompiled);
+
+  return compiled;
+}
+
+#else
+
+MVKE::ShaderWatcher::ShaderWatcher(const std::string &dir) : mDir(dir) {
+  throw std::runtime_error("MVKE was built without shader hot-reload support!");
+}
+
+MVKE::ShaderWatcher::~ShaderWatcher() {}
+
+void MVKE::ShaderWatcher::watchLoop() {}
+
+std::vector<MVKE::CompiledShader> MVKE::ShaderWatcher::poll() {
+  return {};
+}
+
+#endif
\ No newline at end of file
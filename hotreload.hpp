@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace MVKE {
+  struct CompiledShader {
+    std::string name;
+    std::vector<uint32_t> code;
+  };
+
+  // Watches a shader source directory with inotify and recompiles changed
+  // files with glslang on a background thread. Only functional when built
+  // with HOT_RELOAD=1 (MVKE_HOT_RELOAD); otherwise construction throws.
+  class ShaderWatcher {
+  public:
+    ShaderWatcher(const std::string &dir);
+    ~ShaderWatcher();
+    std::vector<MVKE::CompiledShader> poll();
+  private:
+    void watchLoop();
+
+    std::string mDir;
+    int mInotify = -1;
+    std::atomic<bool> mStopping{false};
+    std::thread mThread;
+
+    std::mutex mMutex;
+    std::vector<MVKE::CompiledShader> mCompiled;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "image.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+static void layoutAccess(vk::ImageLayout layout, vk::AccessFlags &access, vk::PipelineStageFlags &stage) {
+  using Access = vk::AccessFlagBits;
+  using Stage = vk::PipelineStageFlagBits;
+
+  switch (layout) {
+  case vk::ImageLayout::eUndefined:
+    access = vk::AccessFlags();
+    stage = Stage::eTopOfPipe;
+    break;
+  case vk::ImageLayout::eTransferDstOptimal:
+    access = Access::eTransferWrite;
+    stage = Stage::eTransfer;
+    break;
+  case vk::ImageLayout::eTransferSrcOptimal:
+    access = Access::eTransferRead;
+    stage = Stage::eTransfer;
+    break;
+  case vk::ImageLayout::eShaderReadOnlyOptimal:
+    access = Access::eShaderRead;
+    stage = Stage::eVertexShader | Stage::eFragmentShader | Stage::eComputeShader;
+    break;
+  case vk::ImageLayout::eColorAttachmentOptimal:
+    access = Access::eColorAttachmentRead | Access::eColorAttachmentWrite;
+    stage = Stage::eColorAttachmentOutput;
+    break;
+  case vk::ImageLayout::eDepthStencilAttachmentOptimal:
+    access = Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite;
+    stage = Stage::eEarlyFragmentTests | Stage::eLateFragmentTests;
+    break;
+  case vk::ImageLayout::ePresentSrcKHR:
+    access = vk::AccessFlags();
+    stage = Stage::eBottomOfPipe;
+    break;
+  default:
+    access = Access::eMemoryRead | Access::eMemoryWrite;
+    stage = Stage::eAllCommands;
+    break;
+  }
+}
+
+MVKE::Image::Image(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels, vk::SampleCountFlagBits samples, VmaMemoryUsage memUsage, vk::MemoryPropertyFlags preferredFlags)
+: mInst(inst), mExtent(extent), mFormat(format), mMipLevels(mipLevels), mAspect(aspectFor(format)) {
+  VmaAllocationCreateInfo createInfo = {};
+  createInfo.usage = memUsage;
+  createInfo.preferredFlags = static_cast<VkMemoryPropertyFlags>(preferredFlags);
+
+  vk::ImageCreateInfo imageInfo(
+    vk::ImageCreateFlags(),
+    vk::ImageType::e2D,
+    format,
+    vk::Extent3D(extent.width, extent.height, 1),
+    mipLevels,
+    1,
+    samples,
+    vk::ImageTiling::eOptimal,
+    usage,
+    vk::SharingMode::eExclusive,
+    0,
+    nullptr,
+    vk::ImageLayout::eUndefined
+  );
+
+  vmaCreateImage(
+    mInst.mAllocator,
+    reinterpret_cast<VkImageCreateInfo *>(&imageInfo),
+    &createInfo,
+    reinterpret_cast<VkImage *>(&mImage),
+    &mAllocation,
+    &mInfo
+  );
+
+  vk::ImageViewCreateInfo viewInfo(
+    vk::ImageViewCreateFlags(),
+    mImage,
+    vk::ImageViewType::e2D,
+    format,
+    vk::ComponentMapping(),
+    vk::ImageSubresourceRange(
+      mAspect,
+      0,
+      mipLevels,
+      0,
+      1
+    )
+  );
+
+  mView = mInst.mDevice->device().createImageViewUnique(viewInfo);
+}
+
+MVKE::Image::~Image() {
+  mView.reset();
+  vmaDestroyImage(mInst.mAllocator, mImage, mAllocation);
+}
+
+void MVKE::Image::transition(const vk::CommandBuffer &cmd, vk::ImageLayout layout) {
+  vk::AccessFlags srcAccess, dstAccess;
+  vk::PipelineStageFlags srcStage, dstStage;
+
+  layoutAccess(mLayout, srcAccess, srcStage);
+  layoutAccess(layout, dstAccess, dstStage);
+
+  vk::ImageMemoryBarrier barrier(
+    srcAccess,
+    dstAccess,
+    mLayout,
+    layout,
+    VK_QUEUE_FAMILY_IGNORED,
+    VK_QUEUE_FAMILY_IGNORED,
+    mImage,
+    vk::ImageSubresourceRange(mAspect, 0, mMipLevels, 0, 1)
+  );
+
+  cmd.pipelineBarrier(srcStage, dstStage, vk::DependencyFlags(), {}, {}, barrier);
+
+  mLayout = layout;
+}
+
+void MVKE::Image::recordUpload(const vk::CommandBuffer &cmd, const vk::Buffer &src, uint64_t offset) {
+  transition(cmd, vk::ImageLayout::eTransferDstOptimal);
+
+  vk::BufferImageCopy region(
+    offset,
+    0,
+    0,
+    vk::ImageSubresourceLayers(mAspect, 0, 0, 1),
+    vk::Offset3D(0, 0, 0),
+    vk::Extent3D(mExtent.width, mExtent.height, 1)
+  );
+
+  cmd.copyBufferToImage(src, mImage, vk::ImageLayout::eTransferDstOptimal, region);
+
+  if (mMipLevels > 1) {
+    recordMipmaps(cmd);
+  } else {
+    transition(cmd, vk::ImageLayout::eShaderReadOnlyOptimal);
+  }
+}
+
+void MVKE::Image::recordMipmaps(const vk::CommandBuffer &cmd) {
+  if (mLayout != vk::ImageLayout::eTransferDstOptimal) {
+    transition(cmd, vk::ImageLayout::eTransferDstOptimal);
+  }
+
+  auto props = mInst.mDevice->formatProperties(mFormat);
+
+  using Feature = vk::FormatFeatureFlagBits;
+  if (!(props.optimalTilingFeatures & Feature::eBlitSrc) || !(props.optimalTilingFeatures & Feature::eBlitDst)) {
+    throw std::runtime_error("Image format does not support blitting for mipmap generation!");
+  }
+
+  vk::Filter filter = props.optimalTilingFeatures & Feature::eSampledImageFilterLinear ? vk::Filter::eLinear : vk::Filter::eNearest;
+
+  using Access = vk::AccessFlagBits;
+  using Stage = vk::PipelineStageFlagBits;
+
+  vk::ImageMemoryBarrier barrier(
+    Access::eTransferWrite,
+    Access::eTransferRead,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageLayout::eTransferSrcOptimal,
+    VK_QUEUE_FAMILY_IGNORED,
+    VK_QUEUE_FAMILY_IGNORED,
+    mImage,
+    vk::ImageSubresourceRange(mAspect, 0, 1, 0, 1)
+  );
+
+  int32_t width = mExtent.width;
+  int32_t height = mExtent.height;
+
+  for (uint32_t i = 1; i < mMipLevels; ++i) {
+    // Level i - 1 has just been written; make it the blit source.
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.srcAccessMask = Access::eTransferWrite;
+    barrier.dstAccessMask = Access::eTransferRead;
+
+    cmd.pipelineBarrier(Stage::eTransfer, Stage::eTransfer, vk::DependencyFlags(), {}, {}, barrier);
+
+    int32_t nextWidth = std::max(width / 2, 1);
+    int32_t nextHeight = std::max(height / 2, 1);
+
+    vk::ImageBlit blit(
+      vk::ImageSubresourceLayers(mAspect, i - 1, 0, 1),
+      {{vk::Offset3D(0, 0, 0), vk::Offset3D(width, height, 1)}},
+      vk::ImageSubresourceLayers(mAspect, i, 0, 1),
+      {{vk::Offset3D(0, 0, 0), vk::Offset3D(nextWidth, nextHeight, 1)}}
+    );
+
+    cmd.blitImage(mImage, vk::ImageLayout::eTransferSrcOptimal, mImage, vk::ImageLayout::eTransferDstOptimal, blit, filter);
+
+    barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+    barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    barrier.srcAccessMask = Access::eTransferRead;
+    barrier.dstAccessMask = Access::eShaderRead;
+
+    cmd.pipelineBarrier(Stage::eTransfer, Stage::eFragmentShader | Stage::eComputeShader, vk::DependencyFlags(), {}, {}, barrier);
+
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  barrier.subresourceRange.baseMipLevel = mMipLevels - 1;
+  barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+  barrier.srcAccessMask = Access::eTransferWrite;
+  barrier.dstAccessMask = Access::eShaderRead;
+
+  cmd.pipelineBarrier(Stage::eTransfer, Stage::eFragmentShader | Stage::eComputeShader, vk::DependencyFlags(), {}, {}, barrier);
+
+  mLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+}
+
+void MVKE::Image::upload(const void *data, uint64_t size) {
+  MVKE::MappableBuffer staging(mInst, size, vk::BufferUsageFlagBits::eTransferSrc);
+
+  memcpy(staging.map(0, size), data, size);
+
+  mInst.submitOneTime([&](const vk::CommandBuffer &cmd) {
+    recordUpload(cmd, staging.buffer(), 0);
+  });
+}
+
+uint32_t MVKE::Image::fullMipChain(vk::Extent2D extent) {
+  uint32_t levels = 1;
+  uint32_t largest = std::max(extent.width, extent.height);
+
+  while (largest >>= 1) ++levels;
+
+  return levels;
+}
+
+vk::ImageAspectFlags MVKE::Image::aspectFor(vk::Format format) {
+  switch (format) {
+  case vk::Format::eD16Unorm:
+  case vk::Format::eX8D24UnormPack32:
+  case vk::Format::eD32Sfloat:
+    return vk::ImageAspectFlagBits::eDepth;
+  case vk::Format::eD16UnormS8Uint:
+  case vk::Format::eD24UnormS8Uint:
+  case vk::Format::eD32SfloatS8Uint:
+    return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  default:
+    return vk::ImageAspectFlagBits::eColor;
+  }
+}
+
+const vk::Image &MVKE::Image::image() const { return mImage; }
+const vk::ImageView &MVKE::Image::view() const { return *mView; }
+vk::ImageLayout MVKE::Image::layout() const { return mLayout; }
+vk::Extent2D MVKE::Image::extent() const { return mExtent; }
+vk::Format MVKE::Image::format() const { return mFormat; }
+uint32_t MVKE::Image::mipLevels() const { return mMipLevels; }
+vk::ImageAspectFlags MVKE::Image::aspect() const { return mAspect; }
+uint64_t MVKE::Image::size() const { return mInfo.size; }
+
+MVKE::Texture::Texture(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, bool mipmapped)
+: MVKE::Image(
+    inst,
+    extent,
+    format,
+    vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc,
+    mipmapped ? fullMipChain(extent) : 1
+  ) {}
+
+MVKE::TransientAttachment::TransientAttachment(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, vk::SampleCountFlagBits samples)
+: MVKE::Image(
+    inst,
+    extent,
+    format,
+    usage | vk::ImageUsageFlagBits::eTransientAttachment,
+    1,
+    samples,
+    VMA_MEMORY_USAGE_GPU_ONLY,
+    vk::MemoryPropertyFlagBits::eLazilyAllocated
+  ) {}
+
+bool MVKE::TransientAttachment::lazilyAllocated() const {
+  VkMemoryPropertyFlags flags;
+  vmaGetMemoryTypeProperties(mInst.mAllocator, mInfo.memoryType, &flags);
+
+  return flags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+}
+
+MVKE::Sampler::Sampler(MVKE::Instance &inst, vk::Filter filter, vk::SamplerAddressMode addressMode) : mInst(inst) {
+  vk::SamplerCreateInfo samplerInfo(
+    vk::SamplerCreateFlags(),
+    filter,
+    filter,
+    filter == vk::Filter::eLinear ? vk::SamplerMipmapMode::eLinear : vk::SamplerMipmapMode::eNearest,
+    addressMode,
+    addressMode,
+    addressMode,
+    0.0f,
+    VK_FALSE,
+    1.0f,
+    VK_FALSE,
+    vk::CompareOp::eAlways,
+    0.0f,
+    VK_LOD_CLAMP_NONE,
+    vk::BorderColor::eIntOpaqueBlack,
+    VK_FALSE
+  );
+
+  mSampler = mInst.mDevice->device().createSamplerUnique(samplerInfo);
+}
+
+const vk::Sampler &MVKE::Sampler::sampler() const { return *mSampler; }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "mvke.hpp"
+#include <vulkan/vulkan.hpp>
+
+namespace MVKE {
+  class Image {
+  public:
+    Image(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, uint32_t mipLevels = 1, vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1, VmaMemoryUsage memUsage = VMA_MEMORY_USAGE_GPU_ONLY, vk::MemoryPropertyFlags preferredFlags = vk::MemoryPropertyFlags());
+    virtual ~Image();
+
+    void transition(const vk::CommandBuffer &cmd, vk::ImageLayout layout);
+    void recordUpload(const vk::CommandBuffer &cmd, const vk::Buffer &src, uint64_t offset);
+    void recordMipmaps(const vk::CommandBuffer &cmd);
+    void upload(const void *data, uint64_t size);
+
+    const vk::Image &image() const;
+    const vk::ImageView &view() const;
+    vk::ImageLayout layout() const;
+    vk::Extent2D extent() const;
+    vk::Format format() const;
+    uint32_t mipLevels() const;
+    vk::ImageAspectFlags aspect() const;
+    uint64_t size() const;
+
+    static uint32_t fullMipChain(vk::Extent2D extent);
+    static vk::ImageAspectFlags aspectFor(vk::Format format);
+
+  protected:
+    MVKE::Instance &mInst;
+    vk::Image mImage;
+    vk::UniqueImageView mView;
+    VmaAllocationInfo mInfo;
+    VmaAllocation mAllocation;
+
+    vk::Extent2D mExtent;
+    vk::Format mFormat;
+    uint32_t mMipLevels;
+    vk::ImageAspectFlags mAspect;
+    vk::ImageLayout mLayout = vk::ImageLayout::eUndefined;
+  };
+
+  class Texture : public Image {
+  public:
+    Texture(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, bool mipmapped = true);
+  };
+
+  // A render pass attachment whose contents never leave the pass (stored
+  // with DONT_CARE). Lazily allocated memory is preferred, so tile-based
+  // GPUs need never back it at all.
+  class TransientAttachment : public Image {
+  public:
+    TransientAttachment(MVKE::Instance &inst, vk::Extent2D extent, vk::Format format, vk::ImageUsageFlags usage, vk::SampleCountFlagBits samples);
+
+    bool lazilyAllocated() const;
+  };
+
+  class Sampler {
+  public:
+    Sampler(MVKE::Instance &inst, vk::Filter filter = vk::Filter::eLinear, vk::SamplerAddressMode addressMode = vk::SamplerAddressMode::eRepeat);
+    const vk::Sampler &sampler() const;
+  private:
+    MVKE::Instance &mInst;
+    vk::UniqueSampler mSampler;
+  };
+}
\ No newline at end of file
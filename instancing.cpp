@@ -0,0 +1,70 @@
+#include "instancing.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+
+#include <cstring>
+
+MVKE::InstanceBatch::InstanceBatch(MVKE::Instance &inst, uint32_t capacity, uint32_t slots, uint32_t indexCount, uint32_t firstIndex, int32_t vertexOffset)
+: mInst(inst), mCapacity(capacity), mSlots(slots), mDraw(indexCount, 0, firstIndex, vertexOffset, 0) {
+  // Keep every region's instance data 16-byte aligned.
+  mHeaderSize = (sizeof mDraw + 15) & ~15;
+  mSlotSize = (mHeaderSize + capacity * sizeof (InstanceData) + 15) & ~15;
+
+  mBuffer = std::make_shared<MVKE::PersistentBuffer>(mInst, mSlotSize * slots, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+
+  // Until a slot is first filled its draw has no instances.
+  for (uint32_t i = 0; i < slots; ++i) {
+    memcpy(static_cast<char *>(mBuffer->data()) + slotOffset(i), &mDraw, sizeof mDraw);
+  }
+
+  mBuffer->flush(0, VK_WHOLE_SIZE);
+}
+
+void MVKE::InstanceBatch::record(const vk::CommandBuffer &cmd, size_t slot, uint32_t binding) const {
+  const auto &dispatch = mInst.mDevice->dispatch();
+  cmd.bindVertexBuffers(binding, {mBuffer->buffer()}, {slotOffset(slot) + mHeaderSize}, dispatch);
+  cmd.drawIndexedIndirect(mBuffer->buffer(), slotOffset(slot), 1, sizeof mDraw, dispatch);
+}
+
+void MVKE::InstanceBatch::begin(size_t slot) {
+  if (slot >= mSlots) throw std::runtime_error("Instance batch slot out of range!");
+
+  mSlot = slot;
+  mCount = 0;
+  mRecording = true;
+}
+
+void MVKE::InstanceBatch::push(const MVKE::InstanceData &instance) {
+  *allocate(1) = instance;
+}
+
+MVKE::InstanceData *MVKE::InstanceBatch::allocate(uint32_t count) {
+  if (!mRecording) throw std::runtime_error("Instance batch used outside begin/end!");
+  if (mCount + count > mCapacity) throw std::runtime_error("Instance batch full!");
+
+  MVKE::InstanceData *data = instances(mSlot) + mCount;
+  mCount += count;
+
+  return data;
+}
+
+void MVKE::InstanceBatch::end() {
+  vk::DrawIndexedIndirectCommand draw = mDraw;
+  draw.instanceCount = mCount;
+
+  memcpy(static_cast<char *>(mBuffer->data()) + slotOffset(mSlot), &draw, sizeof draw);
+  mBuffer->flush(slotOffset(mSlot), mHeaderSize + mCount * sizeof (InstanceData));
+
+  mRecording = false;
+}
+
+vk::DeviceSize MVKE::InstanceBatch::slotOffset(size_t slot) const {
+  return slot * mSlotSize;
+}
+
+MVKE::InstanceData *MVKE::InstanceBatch::instances(size_t slot) const {
+  return reinterpret_cast<MVKE::InstanceData *>(static_cast<char *>(mBuffer->data()) + slotOffset(slot) + mHeaderSize);
+}
+
+uint32_t MVKE::InstanceBatch::capacity() const { return mCapacity; }
+uint32_t MVKE::InstanceBatch::count() const { return mCount; }
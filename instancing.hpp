@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <memory>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // Many copies of one indexed mesh drawn with a single call. The instances'
+  // attributes are streamed through binding 1 at instance rate.
+  //
+  // Each slot (one per swapchain image, matching the pre-recorded command
+  // buffers) owns a region of one persistently mapped buffer: an indirect
+  // draw command followed by the instance data. record() bakes the draw into
+  // a command buffer once; the instance count is read from the region when
+  // the draw executes, so the number of instances can change every frame
+  // without re-recording.
+  class InstanceBatch {
+  public:
+    InstanceBatch(MVKE::Instance &inst, uint32_t capacity, uint32_t slots, uint32_t indexCount, uint32_t firstIndex = 0, int32_t vertexOffset = 0);
+
+    void record(const vk::CommandBuffer &cmd, size_t slot, uint32_t binding = 1) const;
+
+    // The slot must not be in use by the GPU.
+    void begin(size_t slot);
+    void push(const MVKE::InstanceData &instance);
+    // Room for count instances, written in place.
+    MVKE::InstanceData *allocate(uint32_t count);
+    void end();
+
+    uint32_t capacity() const;
+    uint32_t count() const;
+  private:
+    vk::DeviceSize slotOffset(size_t slot) const;
+    MVKE::InstanceData *instances(size_t slot) const;
+
+    MVKE::Instance &mInst;
+
+    uint32_t mCapacity;
+    uint32_t mSlots;
+    vk::DrawIndexedIndirectCommand mDraw;
+
+    vk::DeviceSize mHeaderSize;
+    vk::DeviceSize mSlotSize;
+    std::shared_ptr<MVKE::PersistentBuffer> mBuffer;
+
+    size_t mSlot = 0;
+    uint32_t mCount = 0;
+    bool mRecording = false;
+  };
+}
@@ -6,15 +6,28 @@
 #include <GLFW/glfw3.h>
 
 #include <chrono>
+#include <cstdlib>
 
 #include <string>
 
 #include "device.hpp"
 #include "swapchain.hpp"
 #include "pipeline.hpp"
+#include "shader.hpp"
+#include "reflect.hpp"
+#include "rendergraph.hpp"
+#include "compute.hpp"
+#include "culling.hpp"
+#include "instancing.hpp"
+#include "renderqueue.hpp"
+#include "staticbatch.hpp"
+#include "debugdraw.hpp"
 #include "buffer.hpp"
-
-#define MAX_CONCURRENT_FRAMES (2)
+#include "image.hpp"
+#include "descriptor.hpp"
+#include "bindless.hpp"
+#include "streamer.hpp"
+#include "hotreload.hpp"
 
 const std::vector<const char *> MVKE::Instance::sValidation = {
   "VK_LAYER_LUNARG_standard_validation",
@@ -30,13 +43,16 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
   return VK_FALSE;
 }
 
-MVKE::Instance::Instance(std::string appName, unsigned major, unsigned minor, unsigned patch) {
-  mWindow = std::make_shared<MVKE::GLFW>(800, 600, appName, mFramebufferResized);
+MVKE::Instance::Instance(std::string appName, unsigned major, unsigned minor, unsigned patch, bool headless) : mHeadless(headless) {
   std::vector<const char *> extensions;
   std::vector<const char *> layers;
 
-  for (const char *&ext : mWindow->getVkExtensions()) {
-    extensions.push_back(ext);
+  if (!mHeadless) {
+    mWindow = std::make_shared<MVKE::GLFW>(800, 600, appName, mFramebufferResized);
+
+    for (const char *&ext : mWindow->getVkExtensions()) {
+      extensions.push_back(ext);
+    }
   }
 
   if (sEnableValidation) {
@@ -87,26 +103,52 @@ MVKE::Instance::Instance(std::string appName, unsigned major, unsigned minor, un
     );
   }
 
-  mWindow->initSurface(*mVkInst);
+  if (mWindow) mWindow->initSurface(*mVkInst);
 
-  mDevice = std::make_shared<MVKE::Device>(*this);
+  // Each subsystem lists what it needs and what it can use; the device
+  // enables what it supports and the subsystems check its capabilities.
+  std::vector<MVKE::DeviceFeature> features = MVKE::Device::commonFeatures();
 
-  mSwapchain = std::make_shared<MVKE::Swapchain>(*this);
-  mPipeline = std::make_shared<MVKE::Pipeline>(*this);
-  mSwapchain->initFramebuffers();
+  auto request = [&features](std::vector<MVKE::DeviceFeature> more) {
+    features.insert(features.end(), more.begin(), more.end());
+  };
+
+  if (!mHeadless) request(MVKE::Swapchain::deviceFeatures());
+  request(MVKE::BindlessTable::deviceFeatures());
+  request(MVKE::GpuCuller::deviceFeatures());
+  request(MVKE::StaticBatch::deviceFeatures());
+
+  mDevice = std::make_shared<MVKE::Device>(*this, features);
+  mShaders = std::make_shared<MVKE::ShaderRegistry>(*this);
+  mLayouts = std::make_shared<MVKE::LayoutCache>(*this);
+  mPipelineCache = std::make_shared<MVKE::PipelineStateCache>(*this);
+
+  const char *prepass = std::getenv("MVKE_DEPTH_PREPASS");
+  mDepthPrepass = prepass && std::string(prepass) != "0";
+
+  const char *msaa = std::getenv("MVKE_MSAA");
+  mSamples = mDevice->clampSamples(msaa ? std::strtoul(msaa, nullptr, 10) : 1);
 
   QueueFamilies families = mDevice->findFamilies();
 
+  // Command buffers are re-recorded individually when the render queue changes.
   mCommandPool = mDevice->device().createCommandPoolUnique({
-    vk::CommandPoolCreateFlags(),
+    vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
     *families.graphics
   });
 
-  mVertexBuffer = std::make_shared<MVKE::StagedBuffer>(*this, vertices.size() * sizeof vertices[0], vk::BufferUsageFlagBits::eVertexBuffer);
-
-  memcpy(mVertexBuffer->map(0, mVertexBuffer->size()), vertices.data(), mVertexBuffer->size());
-
-  initCommandBuffers();
+  mDescriptorAllocator = std::make_shared<MVKE::DescriptorAllocator>(*this);
+  mDescriptorCache = std::make_shared<MVKE::DescriptorSetCache>(*this, *mDescriptorAllocator);
+  mBindless = std::make_shared<MVKE::BindlessTable>(*this);
+  mStreamer = std::make_shared<MVKE::Streamer>(*this, 256ull << 20, 16ull << 20);
+  mCompute = std::make_shared<MVKE::ComputeQueue>(*this);
+  mRenderQueue = std::make_shared<MVKE::RenderQueue>();
+  mStatic = std::make_shared<MVKE::StaticBatch>(*this);
+
+#ifdef MVKE_HOT_RELOAD
+  const char *shaderDir = std::getenv("MVKE_SHADER_DIR");
+  mShaderWatcher = std::make_shared<MVKE::ShaderWatcher>(shaderDir ? shaderDir : "shaders");
+#endif
  
   mImageAvailable.reserve(MAX_CONCURRENT_FRAMES);
   mReaderFinished.reserve(MAX_CONCURRENT_FRAMES);
@@ -116,10 +158,59 @@ MVKE::Instance::Instance(std::string appName, unsigned major, unsigned minor, un
     mImageAvailable.push_back(mDevice->device().createSemaphoreUnique(vk::SemaphoreCreateInfo()));
     mReaderFinished.push_back(mDevice->device().createSemaphoreUnique(vk::SemaphoreCreateInfo()));
     mInFlight.push_back(mDevice->device().createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled)));
+    mFrameDescriptors.push_back(std::make_shared<MVKE::DescriptorAllocator>(*this));
   }
+
+  // Without a window there is nothing to present: no swapchain, no sample
+  // scene, and the caller records and submits its own work.
+  if (mHeadless) return;
+
+  mSwapchain = std::make_shared<MVKE::Swapchain>(*this);
+  mPipeline = std::make_shared<MVKE::Pipeline>(*this);
+  mSwapchain->initFramebuffers();
+
+  // Only of interest to someone choosing a sample count.
+  if (msaa) mSwapchain->reportSampleCosts();
+
+  mVertexBuffer = std::make_shared<MVKE::StagedBuffer>(*this, vertices.size() * sizeof vertices[0], vk::BufferUsageFlagBits::eVertexBuffer);
+
+  memcpy(mVertexBuffer->map(0, mVertexBuffer->size()), vertices.data(), mVertexBuffer->size());
+
+  mIndexBuffer = std::make_shared<MVKE::StagedBuffer>(*this, indices.size() * sizeof indices[0], vk::BufferUsageFlagBits::eIndexBuffer);
+
+  memcpy(mIndexBuffer->map(0, mIndexBuffer->size()), indices.data(), mIndexBuffer->size());
+
+  mInstances = std::make_shared<MVKE::InstanceBatch>(*this, 10000, mSwapchain->images().size(), indices.size());
+  mDebug = std::make_shared<MVKE::DebugDraw>(*this, mPipeline->renderPass(), mPipeline->depthPrepass() ? 1 : 0, mSamples, 65536, mSwapchain->images().size());
+
+  // Four static copies of the quad, one per corner, between the big quad
+  // and the instanced grid.
+  auto quad = mStatic->addMesh(vertices, std::vector<uint32_t>(indices.begin(), indices.end()));
+
+  for (int i = 0; i < 4; ++i) {
+    MVKE::StaticDrawData d;
+    d.transform = glm::mat4(1.0f);
+    d.transform[0][0] = d.transform[1][1] = 0.25f;
+    d.transform[3] = glm::vec4(i & 1 ? 0.75f : -0.75f, i & 2 ? 0.75f : -0.75f, 0.25f, 1.0f);
+    d.color = glm::vec4(1.0f, 1.0f, 0.5f, 1.0f);
+    mStatic->add(quad, d);
+  }
+
+  mStatic->commit();
+
+  // The quad, bounded by a sphere around the origin.
+  mCuller = std::make_shared<MVKE::GpuCuller>(*this, std::vector<MVKE::CullObject>{
+    {glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), static_cast<uint32_t>(indices.size()), 0, 0},
+  }, mSwapchain->images().size());
+
+  initCommandBuffers();
 }
 
-void MVKE::Instance::mainLoop() {
+void MVKE::Instance::mainLoop(const MVKE::Instance::FrameCallback &onFrame) {
+  if (mHeadless) {
+    throw std::runtime_error("A headless instance has no main loop!");
+  }
+
   using frame = std::chrono::duration<int64_t, std::ratio<1, 120000>>;
 
   auto cur = std::chrono::high_resolution_clock::now();
@@ -138,39 +229,114 @@ void MVKE::Instance::mainLoop() {
     prev = cur;
 
     mWindow->update();
-    drawFrame();
+    drawFrame(onFrame);
   }
 
   mDevice->device().waitIdle();
 }
 
-void MVKE::Instance::drawFrame() {
-  mDevice->device().waitForFences(*mInFlight[mCurrentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+bool MVKE::Instance::headless() const { return mHeadless; }
+MVKE::Streamer &MVKE::Instance::streamer() { return *mStreamer; }
+MVKE::RenderQueue &MVKE::Instance::renderQueue() { return *mRenderQueue; }
+MVKE::StaticBatch &MVKE::Instance::staticBatch() { return *mStatic; }
+MVKE::InstanceBatch &MVKE::Instance::instanceBatch() { return *mInstances; }
+MVKE::DebugDraw &MVKE::Instance::debugDraw() { return *mDebug; }
+const MVKE::Instance::FrameStats &MVKE::Instance::frameStats() const { return mFrameStats; }
+
+void MVKE::Instance::drawFrame(const MVKE::Instance::FrameCallback &onFrame) {
+  updateShaders();
+
+  const auto &dispatch = mDevice->dispatch();
+
+  mDevice->device().waitForFences(*mInFlight[mCurrentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max(), dispatch);
+
+  // Everything allocated for this frame slot last time round is now idle.
+  mFrameDescriptors[mCurrentFrame]->reset();
+  mBindless->flush(mCurrentFrame);
+  mStreamer->update(mCurrentFrame);
 
   uint32_t imageIndex;
 
   try {
-    imageIndex = mDevice->device().acquireNextImageKHR(mSwapchain->swapchain(), std::numeric_limits<uint64_t>::max(), *mImageAvailable[mCurrentFrame], vk::Fence()).value;
+    imageIndex = mDevice->device().acquireNextImageKHR(mSwapchain->swapchain(), std::numeric_limits<uint64_t>::max(), *mImageAvailable[mCurrentFrame], vk::Fence(), dispatch).value;
   } catch (vk::OutOfDateKHRError &e) {
     recreateSwapchain();
     return;
   }
 
-  mDevice->device().resetFences(*mInFlight[mCurrentFrame]);
+  if (mImagesInFlight[imageIndex]) {
+    mDevice->device().waitForFences(mImagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max(), dispatch);
+  }
+
+  mImagesInFlight[imageIndex] = *mInFlight[mCurrentFrame];
+
+  // The image's cull buffers are idle now. The cull runs on the compute
+  // queue and the draws wait for it; the quad is already in clip space.
+  mFrameWaits.push_back({mCuller->submit(mCurrentFrame, imageIndex, glm::mat4(1.0f)), vk::PipelineStageFlagBits::eDrawIndirect});
+
+  mInstances->begin(imageIndex);
+  if (onFrame) onFrame(imageIndex);
+  mInstances->end();
+
+  updateDebug(imageIndex);
+
+  // Static geometry changes rarely, so the old buffers are simply waited
+  // out and every command buffer picks up the new ones.
+  if (mStatic->dirty()) {
+    mDevice->device().waitIdle();
+    mStatic->commit();
+
+    for (size_t i = 0; i < mCommandBuffers.size(); ++i) {
+      recordCommandBuffer(i);
+    }
+  }
+
+  // Draws pushed since the last frame are sorted once, then each image's
+  // command buffer picks them up the next time it is acquired.
+  mFrameStats.recordMillis = 0.0;
+  mFrameStats.rerecorded = 0;
+
+  if (!mRenderQueue->sorted()) mRenderQueue->sort();
+
+  if (mRecordedQueue[imageIndex] != mRenderQueue->version()) {
+    auto start = std::chrono::high_resolution_clock::now();
+    recordCommandBuffer(imageIndex);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    mFrameStats.recordMillis = elapsed.count();
+    mFrameStats.rerecorded = 1;
+  }
+
+  const auto &queueStats = mRenderQueue->stats();
+  mFrameStats.draws = queueStats.draws;
+  mFrameStats.pipelineBinds = queueStats.pipelineBinds;
+  mFrameStats.descriptorBinds = queueStats.descriptorBinds;
+  mFrameStats.queueBuildMillis = queueStats.buildMillis;
+  mFrameStats.queueSortMillis = queueStats.sortMillis;
+
+  mDevice->device().resetFences(*mInFlight[mCurrentFrame], dispatch);
+
+  std::vector<vk::Semaphore> waits = {*mImageAvailable[mCurrentFrame]};
+  std::vector<vk::PipelineStageFlags> waitStages = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+
+  for (const auto &w : mFrameWaits) {
+    waits.push_back(w.first);
+    waitStages.push_back(w.second);
+  }
 
-  vk::PipelineStageFlags waitStages[] = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+  mFrameWaits.clear();
 
   vk::SubmitInfo submitInfo(
-    1,
-    &mImageAvailable[mCurrentFrame].get(),
-    waitStages,
+    waits.size(),
+    waits.data(),
+    waitStages.data(),
     1,
     &mCommandBuffers[imageIndex].get(),
     1,
     &mReaderFinished[mCurrentFrame].get()
   );
 
-  mQueues.graphics.submit(submitInfo, *mInFlight[mCurrentFrame]);
+  mQueues.graphics.submit(submitInfo, *mInFlight[mCurrentFrame], dispatch);
 
   vk::PresentInfoKHR presentInfo(
     1,
@@ -181,7 +347,7 @@ void MVKE::Instance::drawFrame() {
   );
 
   try {
-    if (mQueues.graphics.presentKHR(presentInfo) == vk::Result::eSuboptimalKHR) {
+    if (mQueues.graphics.presentKHR(presentInfo, dispatch) == vk::Result::eSuboptimalKHR) {
       mFramebufferResized = true;
     }
   } catch (vk::OutOfDateKHRError &e) {
@@ -197,9 +363,71 @@ void MVKE::Instance::drawFrame() {
   mCurrentFrame = (mCurrentFrame + 1) % MAX_CONCURRENT_FRAMES;
 }
 
+void MVKE::Instance::updateShaders() {
+  if (!mShaderWatcher) return;
+
+  for (auto &c : mShaderWatcher->poll()) {
+    mChangedShaders[c.name] = std::move(c.code);
+  }
+
+  if (mReload) {
+    // Rebuilt pipelines compile on the cache's workers; until every one is
+    // done, frames keep drawing with the old ones.
+    for (const auto &p : mReload->pipelines) {
+      if (!p.second->ready() && !p.second->failed()) return;
+    }
+
+    mDevice->device().waitIdle();
+
+    for (const auto &p : mReload->pipelines) {
+      if (p.second->ready()) {
+        mPipeline->replace(p.first, p.second->pipeline());
+        mDebug->replace(p.first, p.second->pipeline());
+      }
+
+      // The old pipeline is retired, not destroyed: other owners, such as
+      // sprite batches, may still bind it until they look it up again.
+      mPipelineCache->settle(p.first, p.second);
+    }
+
+    mReload.reset();
+
+    mCommandBuffers.clear();
+    initCommandBuffers();
+
+    std::cout << "Shaders reloaded" << std::endl;
+  }
+
+  if (mChangedShaders.empty()) return;
+
+  std::unordered_map<VkShaderModule, vk::ShaderModule> swaps;
+  ShaderReload reload;
+
+  // A shader that fails to load or reflect keeps its previous module.
+  for (const auto &c : mChangedShaders) {
+    try {
+      auto old = mShaders->replace(c.first, c.second);
+      if (old) swaps.emplace(static_cast<VkShaderModule>(*old), mShaders->get(c.first));
+      reload.modules.push_back(std::move(old));
+    } catch (std::exception &e) {
+      std::cerr << "Failed to reload " << c.first << ": " << e.what() << std::endl;
+    }
+  }
+
+  mChangedShaders.clear();
+
+  if (reload.modules.empty()) return;
+
+  reload.pipelines = mPipelineCache->rebuild(swaps);
+  mReload = std::move(reload);
+}
+
 void MVKE::Instance::recreateSwapchain() {
   mDevice->device().waitIdle();
 
+  // The window changed, so its extent and transform must be asked again.
+  mDevice->invalidateSurfaceCapabilities();
+
   mSwapchain.reset();
   mPipeline.reset();
 
@@ -213,7 +441,7 @@ void MVKE::Instance::recreateSwapchain() {
   mVertexBuffer.reset();
 
   mCommandPool = mDevice->device().createCommandPoolUnique({
-    vk::CommandPoolCreateFlags(),
+    vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
     *families.graphics
   });
 
@@ -221,10 +449,26 @@ void MVKE::Instance::recreateSwapchain() {
 
   memcpy(mVertexBuffer->map(0, mVertexBuffer->size()), vertices.data(), mVertexBuffer->size());
 
+  // The image count may have changed.
+  mCuller->resize(mSwapchain->images().size());
+  mInstances = std::make_shared<MVKE::InstanceBatch>(*this, mInstances->capacity(), mSwapchain->images().size(), indices.size());
+  mDebug = std::make_shared<MVKE::DebugDraw>(*this, mPipeline->renderPass(), mPipeline->depthPrepass() ? 1 : 0, mSamples, mDebug->capacity(), mSwapchain->images().size());
+
   initCommandBuffers();
 }
 
 
+void MVKE::Instance::submitOneTime(const std::function<void(const vk::CommandBuffer &)> &record) {
+  auto bufs = mDevice->device().allocateCommandBuffersUnique({*mCommandPool, vk::CommandBufferLevel::ePrimary, 1});
+
+  bufs[0]->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+  record(*bufs[0]);
+  bufs[0]->end();
+
+  mQueues.graphics.submit({{0, nullptr, nullptr, 1, &bufs[0].get(), 0, nullptr}}, vk::Fence());
+  mQueues.graphics.waitIdle();
+}
+
 void MVKE::Instance::initCommandBuffers() {
   vk::BufferCreateInfo bufferInfo(
     vk::BufferCreateFlags(),
@@ -241,29 +485,137 @@ void MVKE::Instance::initCommandBuffers() {
 
   mCommandBuffers = mDevice->device().allocateCommandBuffersUnique(allocInfo);
 
+  mGraphs.clear();
+  mImagesInFlight.assign(mCommandBuffers.size(), vk::Fence());
+  mRecordedQueue.assign(mCommandBuffers.size(), 0);
+
   for (size_t i = 0; i < mCommandBuffers.size(); ++i) {
-    vk::CommandBufferBeginInfo beginInfo(
-      vk::CommandBufferUsageFlagBits::eSimultaneousUse,
-      nullptr
+    mGraphs.push_back(buildGraph(i));
+  }
+
+  for (size_t i = 0; i < mCommandBuffers.size(); ++i) {
+    recordCommandBuffer(i);
+  }
+}
+
+// The image's previous submission must have finished.
+void MVKE::Instance::recordCommandBuffer(size_t imageIndex) {
+  vk::CommandBufferBeginInfo beginInfo(
+    vk::CommandBufferUsageFlagBits::eSimultaneousUse,
+    nullptr
+  );
+
+  mCommandBuffers[imageIndex]->begin(beginInfo, mDevice->dispatch());
+  mGraphs[imageIndex]->execute(*mCommandBuffers[imageIndex]);
+  mCommandBuffers[imageIndex]->end(mDevice->dispatch());
+
+  mRecordedQueue[imageIndex] = mRenderQueue->version();
+}
+
+// Hands every line added since the last frame to the image.
+void MVKE::Instance::updateDebug(size_t imageIndex) {
+  mDebug->publish(imageIndex);
+}
+
+// One graph per swapchain image, since each records a different backbuffer.
+// The swapchain image is imported: the acquire semaphore is waited on at
+// colour output, and the graph hands it back ready to present.
+std::shared_ptr<MVKE::RenderGraph> MVKE::Instance::buildGraph(size_t imageIndex) {
+  auto graph = std::make_shared<MVKE::RenderGraph>(*this);
+
+  auto backbuffer = graph->importImage(
+    "backbuffer",
+    mSwapchain->images()[imageIndex],
+    mSwapchain->surfaceFormat().format,
+    mSwapchain->extent(),
+    vk::ImageLayout::eUndefined,
+    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+    vk::AccessFlags(),
+    vk::ImageLayout::ePresentSrcKHR
+  );
+
+  // Cleared every frame, so its previous contents never matter, but the
+  // previous frame's depth writes must still land before this frame's.
+  auto depth = graph->importImage(
+    "depth",
+    mSwapchain->depth().image(),
+    mSwapchain->depth().format(),
+    mSwapchain->extent(),
+    vk::ImageLayout::eUndefined,
+    vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+    vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+    vk::ImageLayout::eUndefined
+  );
+
+  std::optional<MVKE::RenderGraph::ResourceId> msaaColor;
+
+  if (mSwapchain->color()) {
+    msaaColor = graph->importImage(
+      "msaa color",
+      mSwapchain->color()->image(),
+      mSwapchain->color()->format(),
+      mSwapchain->extent(),
+      vk::ImageLayout::eUndefined,
+      vk::PipelineStageFlagBits::eColorAttachmentOutput,
+      vk::AccessFlagBits::eColorAttachmentWrite,
+      vk::ImageLayout::eUndefined
     );
+  }
+
+  auto culled = mCuller->addPasses(*graph, imageIndex);
+
+  graph->addPass("main", [&](MVKE::RenderGraph::PassBuilder &pass) {
+    pass.read(culled.first, MVKE::RenderGraph::Access::eIndirect);
+    pass.read(culled.second, MVKE::RenderGraph::Access::eIndirect);
+    // With MSAA the backbuffer is written by the resolve.
+    pass.write(backbuffer, MVKE::RenderGraph::Access::eColorAttachment);
+    pass.write(depth, MVKE::RenderGraph::Access::eDepthAttachment);
+    if (msaaColor) pass.write(*msaaColor, MVKE::RenderGraph::Access::eColorAttachment);
+  }, [this, imageIndex](const vk::CommandBuffer &cmd) {
+    const auto &dispatch = mDevice->dispatch();
 
-    mCommandBuffers[i]->begin(beginInfo);
+    std::array<vk::ClearValue, 2> clearValues = {
+      vk::ClearColorValue(std::array<float, 4UL>{0.0f, 0.0f, 0.0f, 1.0f}),
+      vk::ClearDepthStencilValue(1.0f, 0),
+    };
 
-    vk::ClearValue clearColor(vk::ClearColorValue(std::array<float, 4UL>{0.0f, 0.0f, 0.0f, 1.0f}));
     vk::RenderPassBeginInfo renderPassInfo(
       mPipeline->renderPass(),
-      *mSwapchain->framebuffers()[i],
+      *mSwapchain->framebuffers()[imageIndex],
       vk::Rect2D({0, 0}, mSwapchain->extent()),
-      1,
-      &clearColor
+      clearValues.size(),
+      clearValues.data()
     );
 
-    mCommandBuffers[i]->beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-    mCommandBuffers[i]->bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline->pipeline());
-    mCommandBuffers[i]->bindVertexBuffers(0, {mVertexBuffer->buffer()}, {0});
-    mCommandBuffers[i]->draw(vertices.size(), 1, 0, 0);
-    mCommandBuffers[i]->endRenderPass();
+    cmd.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline, dispatch);
+    cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, mSwapchain->extent().width, mSwapchain->extent().height, 0.0f, 1.0f), dispatch);
+    cmd.setScissor(0, vk::Rect2D({0, 0}, mSwapchain->extent()), dispatch);
+    cmd.bindVertexBuffers(0, {mVertexBuffer->buffer()}, {0}, dispatch);
+    cmd.bindIndexBuffer(mIndexBuffer->buffer(), 0, vk::IndexType::eUint16, dispatch);
 
-    mCommandBuffers[i]->end();
-  }
+    if (mPipeline->depthPrepass()) {
+      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline->depthPipeline(), dispatch);
+      mCuller->draw(cmd, imageIndex);
+      cmd.nextSubpass(vk::SubpassContents::eInline, dispatch);
+    }
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline->pipeline(), dispatch);
+    mCuller->draw(cmd, imageIndex);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline->instancedPipeline(), dispatch);
+    mInstances->record(cmd, imageIndex);
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, mPipeline->staticPipeline(), dispatch);
+    mStatic->record(cmd);
+
+    mRenderQueue->record(cmd, dispatch);
+
+    mDebug->record(cmd, imageIndex);
+
+    cmd.endRenderPass(dispatch);
+  });
+
+  graph->compile();
+
+  return graph;
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #pragma once
 
+#include <map>
 #include <string>
 #include <vulkan/vulkan.hpp>
 #include <vector>
 #include <optional>
+#include <functional>
 
 #include "glfw.hpp"
 #include "geometry.hpp"
@@ -14,34 +16,124 @@
 #define MVKE_MINOR 1
 #define MVKE_PATCH 0
 
+#define MAX_CONCURRENT_FRAMES (2)
+
 namespace MVKE {
   struct QueueFamilies {
     std::optional<uint32_t> graphics;
     std::optional<uint32_t> present;
+    // A family without graphics when there is one, so compute can overlap
+    // rendering; otherwise the graphics family.
+    std::optional<uint32_t> compute;
 
     bool isComplete() {
       return graphics && present;
     }
   };
 
+  struct DeviceFeature;
+
   class Device;
   class Swapchain;
   class Pipeline;
+  class PipelineStateCache;
+  class ShaderRegistry;
+  class LayoutCache;
+  class ShaderWatcher;
+  class PendingPipeline;
   class Buffer;
   class MappableBuffer;
+  class PersistentBuffer;
   class StagedBuffer;
+  class DescriptorAllocator;
+  class DescriptorSetCache;
+  class BindlessTable;
+  class Image;
+  class Texture;
+  class TransientAttachment;
+  class Sampler;
+  class Streamer;
+  class RenderGraph;
+  class ComputePipeline;
+  class ComputeQueue;
+  class GpuCuller;
+  class InstanceBatch;
+  class RenderQueue;
+  class StaticBatch;
+  class SpriteBatch;
+  class SpriteCanvas;
+  class DebugDraw;
 
   class Instance {
     friend MVKE::Device;
     friend MVKE::Swapchain;
     friend MVKE::Pipeline;
+    friend MVKE::PipelineStateCache;
+    friend MVKE::ShaderRegistry;
+    friend MVKE::LayoutCache;
     friend MVKE::Buffer;
     friend MVKE::MappableBuffer;
+    friend MVKE::PersistentBuffer;
     friend MVKE::StagedBuffer;
+    friend MVKE::DescriptorAllocator;
+    friend MVKE::DescriptorSetCache;
+    friend MVKE::BindlessTable;
+    friend MVKE::Image;
+    friend MVKE::Texture;
+    friend MVKE::TransientAttachment;
+    friend MVKE::Sampler;
+    friend MVKE::Streamer;
+    friend MVKE::RenderGraph;
+    friend MVKE::ComputePipeline;
+    friend MVKE::ComputeQueue;
+    friend MVKE::GpuCuller;
+    friend MVKE::InstanceBatch;
+    friend MVKE::StaticBatch;
+    friend MVKE::SpriteBatch;
+    friend MVKE::SpriteCanvas;
+    friend MVKE::DebugDraw;
   public:
-    Instance(std::string appName, unsigned major, unsigned minor, unsigned patch);
-    void mainLoop();
+    // What the last frame cost on the CPU. The render queue figures come
+    // from its most recent build, sort and record.
+    struct FrameStats {
+      uint32_t draws = 0;
+      uint32_t pipelineBinds = 0;
+      uint32_t descriptorBinds = 0;
+      double queueBuildMillis = 0.0;
+      double queueSortMillis = 0.0;
+      double recordMillis = 0.0;
+      // Command buffers re-recorded because the render queue changed.
+      uint32_t rerecorded = 0;
+    };
+
+    // Called every frame with the swapchain image about to be drawn, once
+    // the GPU is done with the image's previous frame.
+    using FrameCallback = std::function<void(size_t imageIndex)>;
+
+    // A headless instance opens no window and creates no swapchain, for
+    // offscreen work and benchmarks; it has no main loop.
+    Instance(std::string appName, unsigned major, unsigned minor, unsigned patch, bool headless = false);
+    void mainLoop(const FrameCallback &onFrame = nullptr);
+
+    bool headless() const;
+
+    MVKE::Streamer &streamer();
+    // Recorded at the end of the main colour subpass; its pipelines must
+    // target that subpass.
+    MVKE::RenderQueue &renderQueue();
+    // Committed at the start of the next frame after any change.
+    MVKE::StaticBatch &staticBatch();
+    // Instances of the built-in quad. The batch is begun for the image
+    // before the frame callback and ended after it, so the callback only
+    // pushes this frame's instances. Not available when headless.
+    MVKE::InstanceBatch &instanceBatch();
+    // Lines added before the frame callback returns, or between frames, are
+    // drawn by that frame. Not available when headless.
+    MVKE::DebugDraw &debugDraw();
+    const FrameStats &frameStats() const;
   private:
+    bool mHeadless;
+
     vk::UniqueInstance mVkInst;
 
     std::shared_ptr<vk::DispatchLoaderDynamic> mDynamicLoader;
@@ -52,14 +144,22 @@ namespace MVKE {
     struct {
       vk::Queue graphics;
       vk::Queue present;
+      vk::Queue compute;
     } mQueues;
 
     VmaAllocator mAllocator;
 
+    std::shared_ptr<MVKE::ShaderRegistry> mShaders;
+    std::shared_ptr<MVKE::LayoutCache> mLayouts;
+    std::shared_ptr<MVKE::PipelineStateCache> mPipelineCache;
+
     std::shared_ptr<MVKE::Swapchain> mSwapchain;
 
     std::shared_ptr<MVKE::Pipeline> mPipeline;
 
+    bool mDepthPrepass = false;
+    vk::SampleCountFlagBits mSamples = vk::SampleCountFlagBits::e1;
+
     static const std::vector<const char *> sValidation;
 
 #ifndef NDEBUG
@@ -72,29 +172,74 @@ namespace MVKE {
         {{-0.7f, -0.7f}, {0.0f, 1.0f, 0.0f}},
         {{0.7f, -0.7f}, {0.0f, 0.0f, 1.0f}},
         {{-0.7f, 0.7f}, {1.0f, 1.0f, 1.0f}},
-
-        {{-0.7f, 0.7f}, {1.0f, 1.0f, 1.0f}},
-        {{0.7f, -0.7f}, {0.0f, 0.0f, 1.0f}},
         {{0.7f, 0.7f}, {1.0f, 0.0f, 0.0f}},
     };
 
+    const std::vector<uint16_t> indices = {0, 1, 2, 2, 1, 3};
+
     vk::UniqueCommandPool mCommandPool;
     std::vector<vk::UniqueCommandBuffer> mCommandBuffers;
+    std::vector<std::shared_ptr<MVKE::RenderGraph>> mGraphs;
 
     std::vector<vk::UniqueSemaphore> mImageAvailable;
     std::vector<vk::UniqueSemaphore> mReaderFinished;
     std::vector<vk::UniqueFence> mInFlight;
+    // The fence of the frame last drawn to each swapchain image, so data
+    // kept per image is not rewritten while the GPU still reads it.
+    std::vector<vk::Fence> mImagesInFlight;
 
     size_t mCurrentFrame = 0;
 
     bool mFramebufferResized = false;
 
     std::shared_ptr<MVKE::Buffer> mVertexBuffer;
+    std::shared_ptr<MVKE::Buffer> mIndexBuffer;
+
+    std::shared_ptr<MVKE::DescriptorAllocator> mDescriptorAllocator;
+    std::shared_ptr<MVKE::DescriptorSetCache> mDescriptorCache;
+    std::vector<std::shared_ptr<MVKE::DescriptorAllocator>> mFrameDescriptors;
+
+    std::shared_ptr<MVKE::BindlessTable> mBindless;
+    std::shared_ptr<MVKE::Streamer> mStreamer;
+
+    std::shared_ptr<MVKE::ComputeQueue> mCompute;
+    std::shared_ptr<MVKE::GpuCuller> mCuller;
+    std::shared_ptr<MVKE::InstanceBatch> mInstances;
+    std::shared_ptr<MVKE::StaticBatch> mStatic;
+    std::shared_ptr<MVKE::DebugDraw> mDebug;
+
+    std::shared_ptr<MVKE::RenderQueue> mRenderQueue;
+    // The queue version each swapchain image's command buffer last recorded.
+    std::vector<uint64_t> mRecordedQueue;
+    FrameStats mFrameStats;
+    // Extra semaphores this frame's graphics submission waits on, such as
+    // compute work whose results it consumes.
+    std::vector<std::pair<vk::Semaphore, vk::PipelineStageFlags>> mFrameWaits;
+
+    struct ShaderReload {
+      std::vector<vk::UniqueShaderModule> modules;
+      std::vector<std::pair<vk::Pipeline, std::shared_ptr<const MVKE::PendingPipeline>>> pipelines;
+    };
+
+    std::shared_ptr<MVKE::ShaderWatcher> mShaderWatcher;
+    // At most one reload compiles at a time; sources changed meanwhile wait
+    // here, latest code per file, so reloads apply in the order they came.
+    std::optional<ShaderReload> mReload;
+    std::map<std::string, std::vector<uint32_t>> mChangedShaders;
 
-    void drawFrame();
+    void drawFrame(const FrameCallback &onFrame);
 
     void recreateSwapchain();
 
     void initCommandBuffers();
+    void recordCommandBuffer(size_t imageIndex);
+
+    void updateDebug(size_t imageIndex);
+
+    std::shared_ptr<MVKE::RenderGraph> buildGraph(size_t imageIndex);
+
+    void updateShaders();
+
+    void submitOneTime(const std::function<void(const vk::CommandBuffer &)> &record);
   };
 }
\ No newline at end of file
@@ -2,99 +2,223 @@
 #include "swapchain.hpp"
 #include "device.hpp"
 #include "geometry.hpp"
+#include "hash.hpp"
+#include "shader.hpp"
+#include "reflect.hpp"
+#include "image.hpp"
 
 #include <vector>
-#include <fstream>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
-std::vector<char> readFile(const std::string &filename) {
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+bool MVKE::Specialization::empty() const {
+  return entries.empty();
+}
+
+vk::SpecializationInfo MVKE::Specialization::info() const {
+  return vk::SpecializationInfo(entries.size(), entries.data(), data.size(), data.data());
+}
+
+bool MVKE::Specialization::operator==(const MVKE::Specialization &other) const {
+  if (entries.size() != other.entries.size()) return false;
+
+  // Offsets depend on the order constants were set in, so compare values.
+  for (size_t i = 0; i < entries.size(); ++i) {
+    const auto &a = entries[i];
+    const auto &b = other.entries[i];
 
-  if (!file.is_open()) {
-    throw std::runtime_error("Failed to open file!");
+    if (a.constantID != b.constantID || a.size != b.size) return false;
+    if (memcmp(data.data() + a.offset, other.data.data() + b.offset, a.size) != 0) return false;
   }
 
-  size_t filesize = file.tellg();
+  return true;
+}
+
+size_t MVKE::Specialization::hash() const {
+  size_t seed = 0;
 
-  std::vector<char> buf(filesize);
+  for (const auto &e : entries) {
+    MVKE::hashCombine(seed, e.constantID);
 
-  file.seekg(0);
-  file.read(buf.data(), filesize);
-  file.close();
+    for (size_t i = 0; i < e.size; ++i) {
+      MVKE::hashCombine(seed, data[e.offset + i]);
+    }
+  }
 
-  return buf;
+  return seed;
 }
 
-MVKE::Pipeline::Pipeline(MVKE::Instance &inst) : mInst(inst) {
-  initRenderPass();
+bool MVKE::PipelineDesc::operator==(const MVKE::PipelineDesc &other) const {
+  return vertShader == other.vertShader
+    && fragShader == other.fragShader
+    && vertSpecialization == other.vertSpecialization
+    && fragSpecialization == other.fragSpecialization
+    && bindings == other.bindings
+    && attributes == other.attributes
+    && topology == other.topology
+    && polygonMode == other.polygonMode
+    && cullMode == other.cullMode
+    && frontFace == other.frontFace
+    && samples == other.samples
+    && depthTest == other.depthTest
+    && depthWrite == other.depthWrite
+    && depthCompare == other.depthCompare
+    && blendEnable == other.blendEnable
+    && srcColorBlend == other.srcColorBlend
+    && dstColorBlend == other.dstColorBlend
+    && colorBlendOp == other.colorBlendOp
+    && srcAlphaBlend == other.srcAlphaBlend
+    && dstAlphaBlend == other.dstAlphaBlend
+    && alphaBlendOp == other.alphaBlendOp
+    && colorWriteMask == other.colorWriteMask
+    && colorAttachments == other.colorAttachments
+    && layout == other.layout
+    && renderPass == other.renderPass
+    && subpass == other.subpass;
+}
 
-  auto vertCode = readFile("build/shaders/vert.spv");
-  auto fragCode = readFile("build/shaders/frag.spv");
+size_t MVKE::PipelineDesc::hash() const {
+  size_t seed = 0;
 
-  mVertShader = createShader(vertCode);
-  mFragShader = createShader(fragCode);
+  MVKE::hashCombine(seed, static_cast<VkShaderModule>(vertShader));
+  MVKE::hashCombine(seed, static_cast<VkShaderModule>(fragShader));
+  MVKE::hashCombine(seed, vertSpecialization.hash());
+  MVKE::hashCombine(seed, fragSpecialization.hash());
 
-  vk::PipelineShaderStageCreateInfo shaderStages[] = {
-    {
-      vk::PipelineShaderStageCreateFlags(),
-      vk::ShaderStageFlagBits::eVertex,
-      *mVertShader,
-      "main"
-    }, {
+  for (const auto &b : bindings) {
+    MVKE::hashCombine(seed, b.binding);
+    MVKE::hashCombine(seed, b.stride);
+    MVKE::hashCombine(seed, static_cast<uint32_t>(b.inputRate));
+  }
+
+  for (const auto &a : attributes) {
+    MVKE::hashCombine(seed, a.location);
+    MVKE::hashCombine(seed, a.binding);
+    MVKE::hashCombine(seed, static_cast<uint32_t>(a.format));
+    MVKE::hashCombine(seed, a.offset);
+  }
+
+  MVKE::hashCombine(seed, static_cast<uint32_t>(topology));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(polygonMode));
+  MVKE::hashCombine(seed, static_cast<VkFlags>(cullMode));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(frontFace));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(samples));
+  MVKE::hashCombine(seed, depthTest);
+  MVKE::hashCombine(seed, depthWrite);
+  MVKE::hashCombine(seed, static_cast<uint32_t>(depthCompare));
+  MVKE::hashCombine(seed, blendEnable);
+  MVKE::hashCombine(seed, static_cast<uint32_t>(srcColorBlend));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(dstColorBlend));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(colorBlendOp));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(srcAlphaBlend));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(dstAlphaBlend));
+  MVKE::hashCombine(seed, static_cast<uint32_t>(alphaBlendOp));
+  MVKE::hashCombine(seed, static_cast<VkFlags>(colorWriteMask));
+  MVKE::hashCombine(seed, colorAttachments);
+  MVKE::hashCombine(seed, static_cast<VkPipelineLayout>(layout));
+  MVKE::hashCombine(seed, static_cast<VkRenderPass>(renderPass));
+  MVKE::hashCombine(seed, subpass);
+
+  return seed;
+}
+
+size_t MVKE::PipelineDescHash::operator()(const MVKE::PipelineDesc &desc) const {
+  return desc.hash();
+}
+
+bool MVKE::ComputePipelineDesc::operator==(const MVKE::ComputePipelineDesc &other) const {
+  return shader == other.shader
+    && specialization == other.specialization
+    && layout == other.layout;
+}
+
+size_t MVKE::ComputePipelineDesc::hash() const {
+  size_t seed = 0;
+
+  MVKE::hashCombine(seed, static_cast<VkShaderModule>(shader));
+  MVKE::hashCombine(seed, specialization.hash());
+  MVKE::hashCombine(seed, static_cast<VkPipelineLayout>(layout));
+
+  return seed;
+}
+
+size_t MVKE::ComputePipelineDescHash::operator()(const MVKE::ComputePipelineDesc &desc) const {
+  return desc.hash();
+}
+
+// The create-info structs for one description, kept together so a batch of
+// them can be handed to a single createGraphicsPipelines call.
+struct MVKE::PipelineStateCache::BuildState {
+  vk::SpecializationInfo vertSpecInfo;
+  vk::SpecializationInfo fragSpecInfo;
+  std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
+  vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
+  vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+  vk::PipelineViewportStateCreateInfo viewportState;
+  vk::PipelineRasterizationStateCreateInfo rasterizer;
+  vk::PipelineMultisampleStateCreateInfo multisampling;
+  vk::PipelineDepthStencilStateCreateInfo depthStencil;
+  vk::PipelineColorBlendAttachmentState colorBlendAttachment;
+  vk::PipelineColorBlendStateCreateInfo colorBlending;
+  std::array<vk::DynamicState, 2> dynamicStates;
+  vk::PipelineDynamicStateCreateInfo dynamicState;
+  vk::GraphicsPipelineCreateInfo info;
+
+  BuildState(const MVKE::PipelineDesc &desc);
+  BuildState(const BuildState &) = delete;
+};
+
+MVKE::PipelineStateCache::BuildState::BuildState(const MVKE::PipelineDesc &desc)
+: vertSpecInfo(desc.vertSpecialization.info()), fragSpecInfo(desc.fragSpecialization.info()) {
+  shaderStages.push_back({
+    vk::PipelineShaderStageCreateFlags(),
+    vk::ShaderStageFlagBits::eVertex,
+    desc.vertShader,
+    "main",
+    desc.vertSpecialization.empty() ? nullptr : &vertSpecInfo
+  });
+
+  if (desc.fragShader) {
+    shaderStages.push_back({
       vk::PipelineShaderStageCreateFlags(),
       vk::ShaderStageFlagBits::eFragment,
-      *mFragShader,
-      "main"
-    }
-  };
-
-  auto bindingDescription = Vertex::getBindingDescription();
-  auto attributeDescriptions = Vertex::getAttributeDescriptions();
+      desc.fragShader,
+      "main",
+      desc.fragSpecialization.empty() ? nullptr : &fragSpecInfo
+    });
+  }
 
-  vk::PipelineVertexInputStateCreateInfo vertexInputInfo(
+  vertexInputInfo = vk::PipelineVertexInputStateCreateInfo(
     vk::PipelineVertexInputStateCreateFlags(),
-    1,
-    &bindingDescription,
-    attributeDescriptions.size(),
-    attributeDescriptions.data()
+    desc.bindings.size(),
+    desc.bindings.data(),
+    desc.attributes.size(),
+    desc.attributes.data()
   );
 
-  vk::PipelineInputAssemblyStateCreateInfo inputAssembly(
+  inputAssembly = vk::PipelineInputAssemblyStateCreateInfo(
     vk::PipelineInputAssemblyStateCreateFlags(),
-    vk::PrimitiveTopology::eTriangleList,
+    desc.topology,
     VK_FALSE
   );
 
-  vk::Extent2D swapchainExtent = mInst.mSwapchain->extent();
-
-  vk::Viewport viewport(
-    0.0f,
-    0.0f,
-    swapchainExtent.width,
-    swapchainExtent.height,
-    0.0f,
-    1.0f
-  );
-
-  vk::Rect2D scissor(
-    {0, 0},
-    swapchainExtent
-  );
-
-  vk::PipelineViewportStateCreateInfo viewportState(
+  viewportState = vk::PipelineViewportStateCreateInfo(
     vk::PipelineViewportStateCreateFlags(),
     1,
-    &viewport,
+    nullptr,
     1,
-    &scissor
+    nullptr
   );
 
-  vk::PipelineRasterizationStateCreateInfo rasterizer(
+  rasterizer = vk::PipelineRasterizationStateCreateInfo(
     vk::PipelineRasterizationStateCreateFlags(),
     VK_FALSE,
     VK_FALSE,
-    vk::PolygonMode::eFill,
-    vk::CullModeFlagBits::eBack,
-    vk::FrontFace::eClockwise,
+    desc.polygonMode,
+    desc.cullMode,
+    desc.frontFace,
     VK_FALSE,
     0.0f,
     0.0f,
@@ -102,9 +226,9 @@ MVKE::Pipeline::Pipeline(MVKE::Instance &inst) : mInst(inst) {
     1.0f
   );
 
-  vk::PipelineMultisampleStateCreateInfo multisampling(
+  multisampling = vk::PipelineMultisampleStateCreateInfo(
     vk::PipelineMultisampleStateCreateFlags(),
-    vk::SampleCountFlagBits::e1,
+    desc.samples,
     VK_FALSE,
     1.0f,
     nullptr,
@@ -112,119 +236,700 @@ MVKE::Pipeline::Pipeline(MVKE::Instance &inst) : mInst(inst) {
     VK_FALSE
   );
 
-  using ComponentFlag = vk::ColorComponentFlagBits;
-  vk::PipelineColorBlendAttachmentState colorBlendAttachment(
+  depthStencil = vk::PipelineDepthStencilStateCreateInfo(
+    vk::PipelineDepthStencilStateCreateFlags(),
+    desc.depthTest,
+    desc.depthWrite,
+    desc.depthCompare,
     VK_FALSE,
-    vk::BlendFactor::eOne,
-    vk::BlendFactor::eZero,
-    vk::BlendOp::eAdd,
-    vk::BlendFactor::eOne,
-    vk::BlendFactor::eZero,
-    vk::BlendOp::eAdd,
-    ComponentFlag::eR | ComponentFlag::eG | ComponentFlag::eB | ComponentFlag::eA
+    VK_FALSE
+  );
+
+  colorBlendAttachment = vk::PipelineColorBlendAttachmentState(
+    desc.blendEnable,
+    desc.srcColorBlend,
+    desc.dstColorBlend,
+    desc.colorBlendOp,
+    desc.srcAlphaBlend,
+    desc.dstAlphaBlend,
+    desc.alphaBlendOp,
+    desc.colorWriteMask
   );
 
-  vk::PipelineColorBlendStateCreateInfo colorBlending(
+  colorBlending = vk::PipelineColorBlendStateCreateInfo(
     vk::PipelineColorBlendStateCreateFlags(),
     VK_FALSE,
     vk::LogicOp::eCopy,
-    1,
+    desc.colorAttachments,
     &colorBlendAttachment,
     {0, 0, 0, 0}
   );
 
-  vk::PipelineLayoutCreateInfo layoutInfo(
-    vk::PipelineLayoutCreateFlags(),
-    0,
-    nullptr,
-    0,
-    nullptr
-  );
+  dynamicStates = {
+    vk::DynamicState::eViewport,
+    vk::DynamicState::eScissor,
+  };
 
-  mLayout = mInst.mDevice->device().createPipelineLayoutUnique(layoutInfo);
+  dynamicState = vk::PipelineDynamicStateCreateInfo(
+    vk::PipelineDynamicStateCreateFlags(),
+    dynamicStates.size(),
+    dynamicStates.data()
+  );
 
-  vk::GraphicsPipelineCreateInfo pipelineInfo(
+  info = vk::GraphicsPipelineCreateInfo(
     vk::PipelineCreateFlags(),
-    2,
-    shaderStages,
+    shaderStages.size(),
+    shaderStages.data(),
     &vertexInputInfo,
     &inputAssembly,
     nullptr,
     &viewportState,
     &rasterizer,
     &multisampling,
-    nullptr,
+    &depthStencil,
     &colorBlending,
-    nullptr,
-    *mLayout,
-    *mRenderPass,
-    0,
+    &dynamicState,
+    desc.layout,
+    desc.renderPass,
+    desc.subpass,
     vk::Pipeline(),
     -1
   );
+}
+
+bool MVKE::PendingPipeline::ready() const { return mReady; }
+bool MVKE::PendingPipeline::failed() const { return mFailed; }
+vk::Pipeline MVKE::PendingPipeline::pipeline() const { return mReady ? mPipeline : vk::Pipeline(); }
+
+MVKE::PipelineStateCache::PipelineStateCache(MVKE::Instance &inst, unsigned threads) : mInst(inst) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  }
+
+  for (unsigned i = 0; i < threads; ++i) {
+    mThreads.emplace_back(&MVKE::PipelineStateCache::compileLoop, this);
+  }
+}
+
+MVKE::PipelineStateCache::~PipelineStateCache() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+
+  mCond.notify_all();
 
-  mPipeline = mInst.mDevice->device().createGraphicsPipelineUnique(vk::PipelineCache(), pipelineInfo);
+  for (auto &t : mThreads) {
+    t.join();
+  }
 }
 
-vk::UniqueShaderModule MVKE::Pipeline::createShader(const std::vector<char> &code) {
-  vk::ShaderModuleCreateInfo createInfo(
-    vk::ShaderModuleCreateFlags(),
-    code.size(),
-    reinterpret_cast<const uint32_t *>(code.data())
+vk::Pipeline MVKE::PipelineStateCache::get(const MVKE::PipelineDesc &desc) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mPipelines.find(desc);
+
+    if (it != mPipelines.end()) {
+      ++mStats.hits;
+      return *it->second;
+    }
+
+    ++mStats.misses;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  BuildState state(desc);
+  vk::UniquePipeline pipeline = mInst.mDevice->device().createGraphicsPipelineUnique(mInst.mDevice->pipelineCache(), state.info);
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mStats.createMillis += elapsed.count();
+
+  std::cout << "Graphics pipeline created in " << elapsed.count() << "ms (" << mPipelines.size() + 1 << " cached)" << std::endl;
+
+  // A worker may have finished the same description in the meantime.
+  return *mPipelines.emplace(desc, std::move(pipeline)).first->second;
+}
+
+MVKE::PipelineHandle MVKE::PipelineStateCache::request(const MVKE::PipelineDesc &desc) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  auto handle = std::make_shared<MVKE::PendingPipeline>();
+
+  auto it = mPipelines.find(desc);
+
+  if (it != mPipelines.end()) {
+    ++mStats.hits;
+    handle->mPipeline = *it->second;
+    handle->mReady = true;
+    return handle;
+  }
+
+  auto pending = mPending.find(desc);
+
+  if (pending != mPending.end()) {
+    return pending->second;
+  }
+
+  ++mStats.misses;
+
+  mPending.emplace(desc, handle);
+  mQueue.push_back({desc, handle});
+  mCond.notify_one();
+
+  return handle;
+}
+
+vk::Pipeline MVKE::PipelineStateCache::resolve(const MVKE::PipelineHandle &handle) const {
+  if (handle && handle->ready()) return handle->pipeline();
+  return mFallback;
+}
+
+void MVKE::PipelineStateCache::setFallback(const vk::Pipeline &fallback) {
+  mFallback = fallback;
+}
+
+void MVKE::PipelineStateCache::compileLoop() {
+  while (true) {
+    std::vector<Job> batch;
+
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCond.wait(lock, [this] { return mStopping || !mQueue.empty(); });
+
+      if (mStopping) return;
+
+      while (!mQueue.empty() && batch.size() < sBatchSize) {
+        batch.push_back(std::move(mQueue.front()));
+        mQueue.pop_front();
+      }
+
+      ++mCompiling;
+    }
+
+    std::vector<std::unique_ptr<BuildState>> states;
+    std::vector<vk::GraphicsPipelineCreateInfo> infos;
+
+    for (const auto &job : batch) {
+      states.push_back(std::make_unique<BuildState>(job.desc));
+      infos.push_back(states.back()->info);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<vk::UniquePipeline> pipelines;
+
+    try {
+      pipelines = mInst.mDevice->device().createGraphicsPipelinesUnique(mInst.mDevice->pipelineCache(), infos);
+    } catch (vk::SystemError &e) {
+      std::cerr << "Failed to compile pipeline batch: " << e.what() << std::endl;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+
+      for (size_t i = 0; i < batch.size(); ++i) {
+        mPending.erase(batch[i].desc);
+
+        // On failure the handle never becomes ready and draws keep using the fallback.
+        if (pipelines.empty()) {
+          batch[i].handle->mFailed = true;
+          continue;
+        }
+
+        auto res = mPipelines.emplace(batch[i].desc, std::move(pipelines[i]));
+        batch[i].handle->mPipeline = *res.first->second;
+        batch[i].handle->mReady = true;
+      }
+
+      ++mStats.batches;
+      mStats.createMillis += elapsed.count();
+      --mCompiling;
+
+      std::cout << "Compiled " << batch.size() << " graphics pipelines in " << elapsed.count() << "ms (" << mPipelines.size() << " cached)" << std::endl;
+    }
+
+    mIdle.notify_all();
+  }
+}
+
+// Compute pipelines are few and cheap next to graphics ones, so they are
+// always built synchronously.
+vk::Pipeline MVKE::PipelineStateCache::get(const MVKE::ComputePipelineDesc &desc) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mComputePipelines.find(desc);
+
+    if (it != mComputePipelines.end()) {
+      ++mStats.hits;
+      return *it->second;
+    }
+
+    ++mStats.misses;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  vk::SpecializationInfo specInfo = desc.specialization.info();
+
+  vk::ComputePipelineCreateInfo info(
+    vk::PipelineCreateFlags(),
+    vk::PipelineShaderStageCreateInfo(
+      vk::PipelineShaderStageCreateFlags(),
+      vk::ShaderStageFlagBits::eCompute,
+      desc.shader,
+      "main",
+      desc.specialization.empty() ? nullptr : &specInfo
+    ),
+    desc.layout
   );
 
-  return mInst.mDevice->device().createShaderModuleUnique(createInfo);
+  vk::UniquePipeline pipeline = mInst.mDevice->device().createComputePipelineUnique(mInst.mDevice->pipelineCache(), info);
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  mStats.createMillis += elapsed.count();
+
+  std::cout << "Compute pipeline created in " << elapsed.count() << "ms (" << mComputePipelines.size() + 1 << " cached)" << std::endl;
+
+  return *mComputePipelines.emplace(desc, std::move(pipeline)).first->second;
+}
+
+void MVKE::PipelineStateCache::evict(const vk::RenderPass &renderPass) {
+  std::unique_lock<std::mutex> lock(mMutex);
+
+  for (auto it = mQueue.begin(); it != mQueue.end();) {
+    if (it->desc.renderPass == renderPass) {
+      it->handle->mFailed = true;
+      mPending.erase(it->desc);
+      it = mQueue.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // A batch in flight may still reference the render pass.
+  mIdle.wait(lock, [this] { return mCompiling == 0; });
+
+  for (auto it = mPipelines.begin(); it != mPipelines.end();) {
+    if (it->first.renderPass == renderPass) {
+      it = mPipelines.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void MVKE::PipelineStateCache::retire(const vk::Pipeline &pipeline, const vk::Pipeline &replacement) {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  Retired &retired = mRetired[static_cast<VkPipeline>(pipeline)];
+  retired.replacement = replacement;
+
+  for (auto it = mPipelines.begin(); it != mPipelines.end(); ++it) {
+    if (*it->second == pipeline) {
+      retired.pipeline = std::move(it->second);
+      mPipelines.erase(it);
+      break;
+    }
+  }
+
+  for (auto it = mComputePipelines.begin(); it != mComputePipelines.end(); ++it) {
+    if (*it->second == pipeline) {
+      retired.pipeline = std::move(it->second);
+      mComputePipelines.erase(it);
+      break;
+    }
+  }
+
+  if (!replacement) return;
+
+  // Pipelines replaced by this one in an earlier reload skip straight to
+  // the newest.
+  for (auto &r : mRetired) {
+    if (r.second.replacement == pipeline) r.second.replacement = replacement;
+  }
+}
+
+vk::Pipeline MVKE::PipelineStateCache::current(const vk::Pipeline &pipeline) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  auto it = mRetired.find(static_cast<VkPipeline>(pipeline));
+
+  if (it == mRetired.end() || !it->second.replacement) return pipeline;
+  return it->second.replacement;
+}
+
+std::vector<std::pair<vk::Pipeline, MVKE::PipelineHandle>> MVKE::PipelineStateCache::rebuild(const std::unordered_map<VkShaderModule, vk::ShaderModule> &swaps) {
+  std::vector<std::pair<vk::Pipeline, MVKE::PipelineDesc>> affected;
+  std::vector<std::pair<vk::Pipeline, MVKE::ComputePipelineDesc>> affectedCompute;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (const auto &entry : mPipelines) {
+      MVKE::PipelineDesc desc = entry.first;
+      bool changed = false;
+
+      for (vk::ShaderModule *module : {&desc.vertShader, &desc.fragShader}) {
+        auto it = swaps.find(static_cast<VkShaderModule>(*module));
+        if (it != swaps.end()) {
+          *module = it->second;
+          changed = true;
+        }
+      }
+
+      if (changed) affected.push_back({*entry.second, desc});
+    }
+
+    for (const auto &entry : mComputePipelines) {
+      auto it = swaps.find(static_cast<VkShaderModule>(entry.first.shader));
+      if (it == swaps.end()) continue;
+
+      MVKE::ComputePipelineDesc desc = entry.first;
+      desc.shader = it->second;
+      affectedCompute.push_back({*entry.second, desc});
+    }
+
+    for (const auto &a : affected) {
+      mRebuilds[static_cast<VkPipeline>(a.first)] = a.second;
+    }
+  }
+
+  // Compute pipelines have a single stage and are few, so they are rebuilt
+  // here rather than on the workers.
+  for (const auto &a : affectedCompute) {
+    try {
+      retire(a.first, get(a.second));
+    } catch (std::exception &e) {
+      std::cerr << "Failed to rebuild compute pipeline: " << e.what() << std::endl;
+
+      // Its key names a module about to be destroyed; see settle().
+      std::lock_guard<std::mutex> lock(mMutex);
+
+      for (auto it = mComputePipelines.begin(); it != mComputePipelines.end(); ++it) {
+        if (*it->second != a.first) continue;
+
+        vk::UniquePipeline pipeline = std::move(it->second);
+        mComputePipelines.erase(it);
+
+        if (mComputePipelines.count(a.second)) {
+          mRetired[static_cast<VkPipeline>(a.first)].pipeline = std::move(pipeline);
+        } else {
+          mComputePipelines.emplace(a.second, std::move(pipeline));
+        }
+
+        break;
+      }
+    }
+  }
+
+  std::vector<std::pair<vk::Pipeline, MVKE::PipelineHandle>> rebuilt;
+
+  for (const auto &a : affected) {
+    rebuilt.push_back({a.first, request(a.second)});
+  }
+
+  return rebuilt;
+}
+
+void MVKE::PipelineStateCache::settle(const vk::Pipeline &old, const MVKE::PipelineHandle &rebuilt) {
+  if (rebuilt->ready()) {
+    retire(old, rebuilt->pipeline());
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRebuilds.erase(static_cast<VkPipeline>(old));
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mMutex);
+
+  auto desc = mRebuilds.find(static_cast<VkPipeline>(old));
+  if (desc == mRebuilds.end()) return;
+
+  for (auto it = mPipelines.begin(); it != mPipelines.end(); ++it) {
+    if (*it->second != old) continue;
+
+    vk::UniquePipeline pipeline = std::move(it->second);
+    mPipelines.erase(it);
+
+    // Something may have built the new description directly meanwhile.
+    if (mPipelines.count(desc->second)) {
+      mRetired[static_cast<VkPipeline>(old)].pipeline = std::move(pipeline);
+    } else {
+      mPipelines.emplace(desc->second, std::move(pipeline));
+    }
+
+    break;
+  }
+
+  mRebuilds.erase(desc);
+}
+
+size_t MVKE::PipelineStateCache::size() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mPipelines.size();
+}
+
+MVKE::PipelineStateCache::Stats MVKE::PipelineStateCache::stats() const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mStats;
+}
+
+MVKE::Pipeline::Pipeline(MVKE::Instance &inst) : mInst(inst), mDepthPrepass(inst.mDepthPrepass) {
+  initRenderPass();
+
+  const auto &vertReflection = mInst.mShaders->reflection("shader.vert");
+  const auto &fragReflection = mInst.mShaders->reflection("shader.frag");
+
+  mLayout = mInst.mLayouts->pipelineLayout({&vertReflection, &fragReflection});
+
+  uint32_t stride;
+  auto attributes = MVKE::LayoutCache::vertexAttributes(vertReflection, 0, stride);
+
+  if (stride != sizeof (Vertex)) {
+    throw std::runtime_error("Vertex shader inputs do not match MVKE::Vertex!");
+  }
+
+  MVKE::PipelineDesc desc;
+  desc.vertShader = mInst.mShaders->get("shader.vert");
+  desc.fragShader = mInst.mShaders->get("shader.frag");
+  desc.bindings = {Vertex::getBindingDescription()};
+  desc.attributes = attributes;
+  desc.layout = mLayout;
+  desc.renderPass = *mRenderPass;
+  desc.samples = mInst.mSamples;
+  desc.depthTest = true;
+
+  // After the prepass the depth buffer already holds the nearest surface,
+  // so only the fragment that produced it passes and each pixel shades once.
+  desc.depthWrite = !mDepthPrepass;
+  desc.depthCompare = mDepthPrepass ? vk::CompareOp::eEqual : vk::CompareOp::eLess;
+  desc.subpass = mDepthPrepass ? 1 : 0;
+
+  mPipeline = mInst.mPipelineCache->get(desc);
+
+  const auto &instancedReflection = mInst.mShaders->reflection("instanced.vert");
+
+  uint32_t instanceStride;
+  auto instanceAttributes = MVKE::LayoutCache::vertexAttributes(instancedReflection, 1, instanceStride, 2);
+  auto instancedAttributes = MVKE::LayoutCache::vertexAttributes(instancedReflection, 0, stride, 0, 2);
+
+  if (stride != sizeof (Vertex) || instanceStride > sizeof (InstanceData)) {
+    throw std::runtime_error("Instanced shader inputs do not match MVKE::Vertex and MVKE::InstanceData!");
+  }
+
+  instancedAttributes.insert(instancedAttributes.end(), instanceAttributes.begin(), instanceAttributes.end());
+
+  // Instances have no prepass of their own: with one they are tested
+  // against the prepass depth, which is read-only in the colour subpass.
+  MVKE::PipelineDesc instancedDesc = desc;
+  instancedDesc.vertShader = mInst.mShaders->get("instanced.vert");
+  instancedDesc.bindings = {Vertex::getBindingDescription(), InstanceData::getBindingDescription()};
+  instancedDesc.attributes = instancedAttributes;
+  instancedDesc.layout = mInst.mLayouts->pipelineLayout({&instancedReflection, &fragReflection});
+  if (mDepthPrepass) instancedDesc.depthCompare = vk::CompareOp::eLessOrEqual;
+
+  mInstancedPipeline = mInst.mPipelineCache->get(instancedDesc);
+
+  const auto &staticReflection = mInst.mShaders->reflection("static.vert");
+  auto staticAttributes = MVKE::LayoutCache::vertexAttributes(staticReflection, 0, stride);
+
+  if (stride != sizeof (Vertex)) {
+    throw std::runtime_error("Static shader inputs do not match MVKE::Vertex!");
+  }
+
+  // Same depth state as the instanced pipeline, for the same reason.
+  MVKE::PipelineDesc staticDesc = instancedDesc;
+  staticDesc.vertShader = mInst.mShaders->get("static.vert");
+  staticDesc.bindings = {Vertex::getBindingDescription()};
+  staticDesc.attributes = staticAttributes;
+  staticDesc.layout = mInst.mLayouts->pipelineLayout({&staticReflection, &fragReflection});
+
+  mStaticPipeline = mInst.mPipelineCache->get(staticDesc);
+
+  if (!mDepthPrepass) return;
+
+  const auto &depthReflection = mInst.mShaders->reflection("depth.vert");
+  auto depthAttributes = MVKE::LayoutCache::vertexAttributes(depthReflection, 0, stride);
+
+  // Position-only: the prepass reads just the position at the front of each
+  // Vertex, through the same binding as the main pass.
+  if (depthAttributes.size() != 1 || depthAttributes[0].format != attributes[0].format) {
+    throw std::runtime_error("Depth shader inputs do not match MVKE::Vertex!");
+  }
+
+  MVKE::PipelineDesc depthDesc;
+  depthDesc.vertShader = mInst.mShaders->get("depth.vert");
+  depthDesc.bindings = {Vertex::getBindingDescription()};
+  depthDesc.attributes = depthAttributes;
+  depthDesc.colorAttachments = 0;
+  depthDesc.samples = mInst.mSamples;
+  depthDesc.depthTest = true;
+  depthDesc.depthWrite = true;
+  depthDesc.layout = mInst.mLayouts->pipelineLayout({&depthReflection});
+  depthDesc.renderPass = *mRenderPass;
+
+  mDepthPipeline = mInst.mPipelineCache->get(depthDesc);
+}
+
+MVKE::Pipeline::~Pipeline() {
+  mInst.mPipelineCache->evict(*mRenderPass);
 }
 
 void MVKE::Pipeline::initRenderPass() {
-  vk::AttachmentDescription colorAttachment(
-    vk::AttachmentDescriptionFlags(),
-    mInst.mSwapchain->surfaceFormat().format,
-    vk::SampleCountFlagBits::e1,
-    vk::AttachmentLoadOp::eClear,
-    vk::AttachmentStoreOp::eStore,
-    vk::AttachmentLoadOp::eDontCare,
-    vk::AttachmentStoreOp::eDontCare,
-    vk::ImageLayout::eUndefined,
-    vk::ImageLayout::ePresentSrcKHR
-  );
+  // The render graph transitions the attachments and orders them against
+  // other work, so the pass neither changes layouts nor declares external
+  // dependencies.
+  bool msaa = mInst.mSamples != vk::SampleCountFlagBits::e1;
+
+  // With MSAA, attachment 0 is the multisampled colour target, never stored,
+  // and attachment 2 the swapchain image it resolves into.
+  std::vector<vk::AttachmentDescription> attachments = {
+    vk::AttachmentDescription(
+      vk::AttachmentDescriptionFlags(),
+      mInst.mSwapchain->surfaceFormat().format,
+      mInst.mSamples,
+      vk::AttachmentLoadOp::eClear,
+      msaa ? vk::AttachmentStoreOp::eDontCare : vk::AttachmentStoreOp::eStore,
+      vk::AttachmentLoadOp::eDontCare,
+      vk::AttachmentStoreOp::eDontCare,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageLayout::eColorAttachmentOptimal
+    ),
+    vk::AttachmentDescription(
+      vk::AttachmentDescriptionFlags(),
+      mInst.mSwapchain->depth().format(),
+      mInst.mSamples,
+      vk::AttachmentLoadOp::eClear,
+      vk::AttachmentStoreOp::eDontCare,
+      vk::AttachmentLoadOp::eDontCare,
+      vk::AttachmentStoreOp::eDontCare,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal,
+      vk::ImageLayout::eDepthStencilAttachmentOptimal
+    ),
+  };
+
+  if (msaa) {
+    attachments.push_back(vk::AttachmentDescription(
+      vk::AttachmentDescriptionFlags(),
+      mInst.mSwapchain->surfaceFormat().format,
+      vk::SampleCountFlagBits::e1,
+      vk::AttachmentLoadOp::eDontCare,
+      vk::AttachmentStoreOp::eStore,
+      vk::AttachmentLoadOp::eDontCare,
+      vk::AttachmentStoreOp::eDontCare,
+      vk::ImageLayout::eColorAttachmentOptimal,
+      vk::ImageLayout::eColorAttachmentOptimal
+    ));
+  }
 
   vk::AttachmentReference colorAttachmentRef(
     0,
     vk::ImageLayout::eColorAttachmentOptimal
   );
 
-  vk::SubpassDescription subpass(
-    vk::SubpassDescriptionFlags(),
-    vk::PipelineBindPoint::eGraphics,
-    0,
-    nullptr,
-    1,
-    &colorAttachmentRef
+  vk::AttachmentReference resolveAttachmentRef(
+    2,
+    vk::ImageLayout::eColorAttachmentOptimal
   );
 
-  vk::RenderPassCreateInfo renderPassInfo(
-    vk::RenderPassCreateFlags(),
+  vk::AttachmentReference depthAttachmentRef(
     1,
-    &colorAttachment,
-    1,
-    &subpass
+    vk::ImageLayout::eDepthStencilAttachmentOptimal
   );
 
-  vk::SubpassDependency dependency(
-    VK_SUBPASS_EXTERNAL,
-    0,
-    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    vk::PipelineStageFlagBits::eColorAttachmentOutput,
-    vk::AccessFlags(),
-    vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite
+  // The main pass only tests against the prepass's depth.
+  vk::AttachmentReference depthReadRef(
+    1,
+    vk::ImageLayout::eDepthStencilReadOnlyOptimal
   );
 
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &dependency;
+  std::vector<vk::SubpassDescription> subpasses;
+  std::vector<vk::SubpassDependency> dependencies;
+
+  if (mDepthPrepass) {
+    subpasses.push_back(vk::SubpassDescription(
+      vk::SubpassDescriptionFlags(),
+      vk::PipelineBindPoint::eGraphics,
+      0,
+      nullptr,
+      0,
+      nullptr,
+      nullptr,
+      &depthAttachmentRef
+    ));
+
+    subpasses.push_back(vk::SubpassDescription(
+      vk::SubpassDescriptionFlags(),
+      vk::PipelineBindPoint::eGraphics,
+      0,
+      nullptr,
+      1,
+      &colorAttachmentRef,
+      msaa ? &resolveAttachmentRef : nullptr,
+      &depthReadRef
+    ));
+
+    dependencies.push_back(vk::SubpassDependency(
+      0,
+      1,
+      vk::PipelineStageFlagBits::eLateFragmentTests,
+      vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+      vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+      vk::AccessFlagBits::eDepthStencilAttachmentRead,
+      vk::DependencyFlagBits::eByRegion
+    ));
+  } else {
+    subpasses.push_back(vk::SubpassDescription(
+      vk::SubpassDescriptionFlags(),
+      vk::PipelineBindPoint::eGraphics,
+      0,
+      nullptr,
+      1,
+      &colorAttachmentRef,
+      msaa ? &resolveAttachmentRef : nullptr,
+      &depthAttachmentRef
+    ));
+  }
+
+  vk::RenderPassCreateInfo renderPassInfo(
+    vk::RenderPassCreateFlags(),
+    attachments.size(),
+    attachments.data(),
+    subpasses.size(),
+    subpasses.data(),
+    dependencies.size(),
+    dependencies.data()
+  );
 
   mRenderPass = mInst.mDevice->device().createRenderPassUnique(renderPassInfo);
 }
 
 const vk::RenderPass &MVKE::Pipeline::renderPass() const { return *mRenderPass; }
-const vk::Pipeline &MVKE::Pipeline::pipeline() const { return *mPipeline; }
\ No newline at end of file
+const vk::Pipeline &MVKE::Pipeline::pipeline() const { return mPipeline; }
+const vk::Pipeline &MVKE::Pipeline::depthPipeline() const { return mDepthPipeline; }
+const vk::Pipeline &MVKE::Pipeline::instancedPipeline() const { return mInstancedPipeline; }
+const vk::Pipeline &MVKE::Pipeline::staticPipeline() const { return mStaticPipeline; }
+bool MVKE::Pipeline::depthPrepass() const { return mDepthPrepass; }
+
+bool MVKE::Pipeline::replace(const vk::Pipeline &from, const vk::Pipeline &to) {
+  bool replaced = false;
+
+  for (vk::Pipeline *p : {&mPipeline, &mDepthPipeline, &mInstancedPipeline, &mStaticPipeline}) {
+    if (*p != from) continue;
+    *p = to;
+    replaced = true;
+  }
+
+  return replaced;
+}
\ No newline at end of file
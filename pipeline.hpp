@@ -1,23 +1,236 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
 #include "mvke.hpp"
 
 namespace MVKE {
+  // Specialization constant values for one shader stage. Entries are kept
+  // sorted by constant ID so the same values compare and hash equal however
+  // they were set.
+  struct Specialization {
+    std::vector<vk::SpecializationMapEntry> entries;
+    std::vector<uint8_t> data;
+
+    template<typename T>
+    Specialization &set(uint32_t id, const T &value) {
+      static_assert(std::is_trivially_copyable<T>::value, "Specialization constants must be plain data");
+
+      auto it = std::find_if(entries.begin(), entries.end(), [id](const vk::SpecializationMapEntry &e) { return e.constantID >= id; });
+
+      if (it != entries.end() && it->constantID == id) {
+        if (it->size != sizeof value) {
+          throw std::runtime_error("Specialization constant size mismatch!");
+        }
+      } else {
+        it = entries.insert(it, {id, static_cast<uint32_t>(data.size()), sizeof value});
+        data.resize(data.size() + sizeof value);
+      }
+
+      memcpy(data.data() + it->offset, &value, sizeof value);
+      return *this;
+    }
+
+    // GLSL bool constants are 32 bits wide.
+    Specialization &set(uint32_t id, bool value) {
+      return set<VkBool32>(id, value ? VK_TRUE : VK_FALSE);
+    }
+
+    bool empty() const;
+    vk::SpecializationInfo info() const;
+
+    bool operator==(const Specialization &other) const;
+    size_t hash() const;
+  };
+
+  // Everything that distinguishes one graphics pipeline from another.
+  // Viewport and scissor are dynamic, so a description does not depend on
+  // the swapchain extent.
+  struct PipelineDesc {
+    vk::ShaderModule vertShader;
+    vk::ShaderModule fragShader;
+
+    MVKE::Specialization vertSpecialization;
+    MVKE::Specialization fragSpecialization;
+
+    std::vector<vk::VertexInputBindingDescription> bindings;
+    std::vector<vk::VertexInputAttributeDescription> attributes;
+
+    vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+    vk::PolygonMode polygonMode = vk::PolygonMode::eFill;
+    vk::CullModeFlags cullMode = vk::CullModeFlagBits::eBack;
+    vk::FrontFace frontFace = vk::FrontFace::eClockwise;
+
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+    bool depthTest = false;
+    bool depthWrite = false;
+    vk::CompareOp depthCompare = vk::CompareOp::eLess;
+
+    bool blendEnable = false;
+    vk::BlendFactor srcColorBlend = vk::BlendFactor::eOne;
+    vk::BlendFactor dstColorBlend = vk::BlendFactor::eZero;
+    vk::BlendOp colorBlendOp = vk::BlendOp::eAdd;
+    vk::BlendFactor srcAlphaBlend = vk::BlendFactor::eOne;
+    vk::BlendFactor dstAlphaBlend = vk::BlendFactor::eZero;
+    vk::BlendOp alphaBlendOp = vk::BlendOp::eAdd;
+    vk::ColorComponentFlags colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
+    // 0 for depth-only subpasses.
+    uint32_t colorAttachments = 1;
+
+    vk::PipelineLayout layout;
+    vk::RenderPass renderPass;
+    uint32_t subpass = 0;
+
+    bool operator==(const PipelineDesc &other) const;
+    size_t hash() const;
+  };
+
+  struct PipelineDescHash {
+    size_t operator()(const MVKE::PipelineDesc &desc) const;
+  };
+
+  struct ComputePipelineDesc {
+    vk::ShaderModule shader;
+    MVKE::Specialization specialization;
+    vk::PipelineLayout layout;
+
+    bool operator==(const ComputePipelineDesc &other) const;
+    size_t hash() const;
+  };
+
+  struct ComputePipelineDescHash {
+    size_t operator()(const MVKE::ComputePipelineDesc &desc) const;
+  };
+
+  class PipelineStateCache;
+
+  // A pipeline that may still be compiling on a worker thread.
+  class PendingPipeline {
+    friend PipelineStateCache;
+  public:
+    bool ready() const;
+    bool failed() const;
+    vk::Pipeline pipeline() const;
+  private:
+    std::atomic<bool> mReady{false};
+    std::atomic<bool> mFailed{false};
+    vk::Pipeline mPipeline;
+  };
+
+  using PipelineHandle = std::shared_ptr<const MVKE::PendingPipeline>;
+
+  class PipelineStateCache {
+  public:
+    struct Stats {
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+      uint64_t batches = 0;
+      double createMillis = 0.0;
+    };
+
+    PipelineStateCache(MVKE::Instance &inst, unsigned threads = 0);
+    ~PipelineStateCache();
+
+    vk::Pipeline get(const MVKE::PipelineDesc &desc);
+    vk::Pipeline get(const MVKE::ComputePipelineDesc &desc);
+    MVKE::PipelineHandle request(const MVKE::PipelineDesc &desc);
+    vk::Pipeline resolve(const MVKE::PipelineHandle &handle) const;
+    void setFallback(const vk::Pipeline &fallback);
+    void evict(const vk::RenderPass &renderPass);
+    // Takes a pipeline out of the cache without destroying it, since owners
+    // other than the caller may still bind it. current() then maps it to its
+    // replacement, if it has one; owners that record every frame look their
+    // pipelines up through it.
+    void retire(const vk::Pipeline &pipeline, const vk::Pipeline &replacement = vk::Pipeline());
+    vk::Pipeline current(const vk::Pipeline &pipeline) const;
+
+    // Requests every graphics pipeline built from a swapped module again.
+    // Compute pipelines are rebuilt before it returns and retired in favour
+    // of the new ones; one that fails to build is kept, as in settle().
+    std::vector<std::pair<vk::Pipeline, MVKE::PipelineHandle>> rebuild(const std::unordered_map<VkShaderModule, vk::ShaderModule> &swaps);
+    // Once a rebuild has finished, its pipeline replaces the old one. If it
+    // failed, the old pipeline is kept under the new description instead,
+    // since its key names a module about to be destroyed and the next reload
+    // of the same shaders must still find it.
+    void settle(const vk::Pipeline &old, const MVKE::PipelineHandle &rebuilt);
+
+    size_t size() const;
+    Stats stats() const;
+  private:
+    struct BuildState;
+
+    struct Job {
+      MVKE::PipelineDesc desc;
+      std::shared_ptr<MVKE::PendingPipeline> handle;
+    };
+
+    struct Retired {
+      vk::UniquePipeline pipeline;
+      vk::Pipeline replacement;
+    };
+
+    void compileLoop();
+
+    MVKE::Instance &mInst;
+
+    std::unordered_map<MVKE::PipelineDesc, vk::UniquePipeline, MVKE::PipelineDescHash> mPipelines;
+    std::unordered_map<MVKE::ComputePipelineDesc, vk::UniquePipeline, MVKE::ComputePipelineDescHash> mComputePipelines;
+    std::unordered_map<MVKE::PipelineDesc, std::shared_ptr<MVKE::PendingPipeline>, MVKE::PipelineDescHash> mPending;
+    std::deque<Job> mQueue;
+    // Kept alive until the cache goes, as nothing tracks who still binds them.
+    std::unordered_map<VkPipeline, Retired> mRetired;
+    // The description each pipeline being rebuilt is requested under.
+    std::unordered_map<VkPipeline, MVKE::PipelineDesc> mRebuilds;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mCond;
+    std::condition_variable mIdle;
+    unsigned mCompiling = 0;
+    bool mStopping = false;
+    std::vector<std::thread> mThreads;
+
+    vk::Pipeline mFallback;
+
+    Stats mStats;
+
+    static const size_t sBatchSize = 16;
+  };
+
   class Pipeline {
   public:
     Pipeline(MVKE::Instance &inst);
+    ~Pipeline();
     const vk::RenderPass &renderPass() const;
     const vk::Pipeline &pipeline() const;
+    const vk::Pipeline &depthPipeline() const;
+    const vk::Pipeline &instancedPipeline() const;
+    const vk::Pipeline &staticPipeline() const;
+    bool depthPrepass() const;
+    bool replace(const vk::Pipeline &from, const vk::Pipeline &to);
   private:
     MVKE::Instance &mInst;
-    
-    vk::UniqueShaderModule createShader(const std::vector<char> &code);
-    vk::UniqueShaderModule mVertShader;
-    vk::UniqueShaderModule mFragShader;
-    vk::UniquePipelineLayout mLayout;
+
+    bool mDepthPrepass;
+
+    vk::PipelineLayout mLayout;
     vk::UniqueRenderPass mRenderPass;
-    vk::UniquePipeline mPipeline;
+    vk::Pipeline mPipeline;
+    vk::Pipeline mDepthPipeline;
+    vk::Pipeline mInstancedPipeline;
+    vk::Pipeline mStaticPipeline;
 
     void initRenderPass();
   };
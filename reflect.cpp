@@ -0,0 +1,494 @@
+#include "reflect.hpp"
+#include "device.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <optional>
+
+namespace {
+  enum Op : uint16_t {
+    OpEntryPoint = 15,
+    OpExecutionMode = 16,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+  };
+
+  enum Decoration : uint32_t {
+    DecorationBlock = 2,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationBuiltIn = 11,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+  };
+
+  enum StorageClass : uint32_t {
+    StorageUniformConstant = 0,
+    StorageInput = 1,
+    StorageUniform = 2,
+    StoragePushConstant = 9,
+    StorageStorageBuffer = 12,
+  };
+
+  struct Id {
+    uint16_t op = 0;
+    std::vector<uint32_t> operands;
+
+    std::optional<uint32_t> location;
+    std::optional<uint32_t> binding;
+    std::optional<uint32_t> set;
+    bool builtin = false;
+    bool bufferBlock = false;
+    uint32_t arrayStride = 0;
+    std::vector<uint32_t> memberOffsets;
+
+    uint32_t operand(size_t i) const {
+      if (i >= operands.size()) {
+        throw std::runtime_error("Malformed SPIR-V instruction!");
+      }
+
+      return operands[i];
+    }
+  };
+
+  struct Module {
+    std::vector<Id> ids;
+
+    // Ids are checked against the bound in the module header.
+    Id &at(uint32_t id) {
+      if (id >= ids.size()) {
+        throw std::runtime_error("SPIR-V id out of bounds!");
+      }
+
+      return ids[id];
+    }
+
+    const Id &at(uint32_t id) const {
+      return const_cast<Module *>(this)->at(id);
+    }
+
+    // Only a plain 32-bit integer constant; a specialization constant would
+    // need its specialized value, which is not known here.
+    uint32_t arrayLength(uint32_t id) const {
+      const Id &c = at(id);
+
+      if (c.op != OpConstant || c.operands.size() != 2 || at(c.operands[0]).op != OpTypeInt || at(c.operands[0]).operand(0) != 32) {
+        throw std::runtime_error("Unsupported SPIR-V array length!");
+      }
+
+      return c.operands[1];
+    }
+
+    uint32_t sizeOf(uint32_t id) const {
+      const Id &t = at(id);
+
+      switch (t.op) {
+      case OpTypeInt:
+      case OpTypeFloat:
+        return t.operand(0) / 8;
+      case OpTypeVector:
+      case OpTypeMatrix:
+        return sizeOf(t.operand(0)) * t.operand(1);
+      case OpTypeArray: {
+        uint32_t stride = t.arrayStride ? t.arrayStride : sizeOf(t.operand(0));
+        return stride * arrayLength(t.operand(1));
+      }
+      case OpTypeStruct: {
+        uint32_t size = 0, offset = 0;
+
+        for (size_t m = 0; m < t.operands.size(); ++m) {
+          if (m < t.memberOffsets.size() && t.memberOffsets[m] != ~0u) offset = t.memberOffsets[m];
+          offset += sizeOf(t.operands[m]);
+          size = std::max(size, offset);
+        }
+
+        return size;
+      }
+      default:
+        return 0;
+      }
+    }
+
+    // Scalars and vectors of 32-bit types; anything else is undefined.
+    vk::Format formatOf(uint32_t id) const {
+      const Id &t = at(id);
+
+      uint32_t components = 1;
+      const Id *scalar = &t;
+
+      if (t.op == OpTypeVector) {
+        components = t.operand(1);
+        scalar = &at(t.operand(0));
+      }
+
+      if (scalar->operands.empty() || scalar->operands[0] != 32) return vk::Format::eUndefined;
+
+      static const vk::Format floats[] = {vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat, vk::Format::eR32G32B32A32Sfloat};
+      static const vk::Format sints[] = {vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint};
+      static const vk::Format uints[] = {vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint};
+
+      if (components < 1 || components > 4) return vk::Format::eUndefined;
+
+      if (scalar->op == OpTypeFloat) return floats[components - 1];
+      if (scalar->op == OpTypeInt) return scalar->operand(1) ? sints[components - 1] : uints[components - 1];
+
+      return vk::Format::eUndefined;
+    }
+  };
+}
+
+MVKE::ShaderReflection MVKE::reflectSPIRV(const uint32_t *code, size_t size) {
+  size_t count = size / sizeof (uint32_t);
+
+  if (count < 5 || code[0] != 0x07230203) {
+    throw std::runtime_error("Invalid SPIR-V module!");
+  }
+
+  MVKE::ShaderReflection refl;
+  Module mod;
+  mod.ids.resize(code[3]);
+
+  std::vector<uint32_t> variables;
+
+  for (size_t i = 5; i < count;) {
+    uint16_t op = code[i] & 0xffff;
+    uint16_t wordCount = code[i] >> 16;
+
+    if (wordCount == 0 || i + wordCount > count) {
+      throw std::runtime_error("Truncated SPIR-V module!");
+    }
+
+    const uint32_t *w = code + i;
+
+    auto need = [wordCount](uint16_t words) {
+      if (wordCount < words) {
+        throw std::runtime_error("Malformed SPIR-V instruction!");
+      }
+    };
+
+    switch (op) {
+    case OpEntryPoint:
+      need(2);
+      switch (w[1]) {
+      case 0: refl.stage = vk::ShaderStageFlagBits::eVertex; break;
+      case 1: refl.stage = vk::ShaderStageFlagBits::eTessellationControl; break;
+      case 2: refl.stage = vk::ShaderStageFlagBits::eTessellationEvaluation; break;
+      case 3: refl.stage = vk::ShaderStageFlagBits::eGeometry; break;
+      case 4: refl.stage = vk::ShaderStageFlagBits::eFragment; break;
+      case 5: refl.stage = vk::ShaderStageFlagBits::eCompute; break;
+      }
+      break;
+    case OpExecutionMode:
+      need(3);
+      // LocalSize; a spec-constant workgroup size keeps the default.
+      if (w[2] == 17) {
+        need(6);
+        refl.localSize = {w[3], w[4], w[5]};
+      }
+      break;
+    case OpDecorate: {
+      need(3);
+      Id &id = mod.at(w[1]);
+      switch (w[2]) {
+      case DecorationLocation: need(4); id.location = w[3]; break;
+      case DecorationBinding: need(4); id.binding = w[3]; break;
+      case DecorationDescriptorSet: need(4); id.set = w[3]; break;
+      case DecorationBuiltIn: id.builtin = true; break;
+      case DecorationBufferBlock: id.bufferBlock = true; break;
+      case DecorationArrayStride: need(4); id.arrayStride = w[3]; break;
+      }
+      break;
+    }
+    case OpMemberDecorate: {
+      need(4);
+      Id &id = mod.at(w[1]);
+      if (w[3] == DecorationBuiltIn) {
+        id.builtin = true;
+      } else if (w[3] == DecorationOffset) {
+        need(5);
+        // The universal limit on struct members.
+        if (w[2] >= 16383) throw std::runtime_error("Malformed SPIR-V instruction!");
+        if (id.memberOffsets.size() <= w[2]) id.memberOffsets.resize(w[2] + 1, ~0u);
+        id.memberOffsets[w[2]] = w[4];
+      }
+      break;
+    }
+    case OpTypeInt:
+    case OpTypeFloat:
+    case OpTypeVector:
+    case OpTypeMatrix:
+    case OpTypeImage:
+    case OpTypeSampler:
+    case OpTypeSampledImage:
+    case OpTypeArray:
+    case OpTypeRuntimeArray:
+    case OpTypeStruct:
+    case OpTypePointer:
+      need(2);
+      mod.at(w[1]).op = op;
+      mod.at(w[1]).operands.assign(w + 2, w + wordCount);
+      break;
+    case OpConstant: {
+      need(4);
+      // Stored as {type, value words...}; see Module::arrayLength().
+      Id &id = mod.at(w[2]);
+      id.op = op;
+      id.operands.assign(w + 3, w + wordCount);
+      id.operands.insert(id.operands.begin(), w[1]);
+      break;
+    }
+    case OpVariable:
+      need(4);
+      mod.at(w[2]).op = op;
+      mod.at(w[2]).operands = {w[1], w[3]};
+      variables.push_back(w[2]);
+      break;
+    }
+
+    i += wordCount;
+  }
+
+  for (uint32_t v : variables) {
+    const Id &var = mod.at(v);
+    const Id &ptr = mod.at(var.operand(0));
+    uint32_t storage = var.operand(1);
+    uint32_t type = ptr.operand(1);
+
+    if (var.builtin || mod.at(type).builtin) continue;
+
+    switch (storage) {
+    case StorageInput: {
+      if (!var.location) break;
+
+      const Id &t = mod.at(type);
+
+      // Matrices take one location per column.
+      uint32_t columns = t.op == OpTypeMatrix ? t.operand(1) : 1;
+      uint32_t column = t.op == OpTypeMatrix ? t.operand(0) : type;
+
+      for (uint32_t c = 0; c < columns; ++c) {
+        refl.inputs.push_back({*var.location + c, mod.formatOf(column), mod.sizeOf(column)});
+      }
+      break;
+    }
+    case StorageUniformConstant:
+    case StorageUniform:
+    case StorageStorageBuffer: {
+      uint32_t count = 1;
+
+      while (mod.at(type).op == OpTypeArray || mod.at(type).op == OpTypeRuntimeArray) {
+        const Id &arr = mod.at(type);
+        count = arr.op == OpTypeArray ? count * mod.arrayLength(arr.operand(1)) : 0;
+        type = arr.operand(0);
+      }
+
+      const Id &t = mod.at(type);
+      vk::DescriptorType descType;
+
+      switch (t.op) {
+      case OpTypeStruct:
+        descType = storage == StorageStorageBuffer || t.bufferBlock ? vk::DescriptorType::eStorageBuffer : vk::DescriptorType::eUniformBuffer;
+        break;
+      case OpTypeSampledImage:
+        descType = vk::DescriptorType::eCombinedImageSampler;
+        break;
+      case OpTypeSampler:
+        descType = vk::DescriptorType::eSampler;
+        break;
+      case OpTypeImage: {
+        uint32_t dim = t.operand(1);
+        uint32_t sampled = t.operand(5);
+
+        if (dim == 5) {
+          descType = sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+        } else if (dim == 6) {
+          descType = vk::DescriptorType::eInputAttachment;
+        } else {
+          descType = sampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+        }
+        break;
+      }
+      default:
+        continue;
+      }
+
+      refl.bindings.push_back({var.set.value_or(0), var.binding.value_or(0), descType, count});
+      break;
+    }
+    case StoragePushConstant:
+      refl.pushConstantSize = std::max(refl.pushConstantSize, mod.sizeOf(type));
+      break;
+    }
+  }
+
+  std::sort(refl.inputs.begin(), refl.inputs.end(), [](const auto &a, const auto &b) {
+    return a.location < b.location;
+  });
+
+  std::sort(refl.bindings.begin(), refl.bindings.end(), [](const auto &a, const auto &b) {
+    return a.set < b.set || (a.set == b.set && a.binding < b.binding);
+  });
+
+  return refl;
+}
+
+bool MVKE::LayoutCache::SetKey::operator==(const MVKE::LayoutCache::SetKey &other) const {
+  return bindings == other.bindings;
+}
+
+bool MVKE::LayoutCache::PipelineKey::operator==(const MVKE::LayoutCache::PipelineKey &other) const {
+  return sets == other.sets && ranges == other.ranges;
+}
+
+size_t MVKE::LayoutCache::KeyHash::operator()(const MVKE::LayoutCache::SetKey &key) const {
+  size_t seed = 0;
+
+  for (const auto &b : key.bindings) {
+    MVKE::hashCombine(seed, b.binding);
+    MVKE::hashCombine(seed, static_cast<uint32_t>(b.descriptorType));
+    MVKE::hashCombine(seed, b.descriptorCount);
+    MVKE::hashCombine(seed, static_cast<VkFlags>(b.stageFlags));
+  }
+
+  return seed;
+}
+
+size_t MVKE::LayoutCache::KeyHash::operator()(const MVKE::LayoutCache::PipelineKey &key) const {
+  size_t seed = 0;
+
+  for (const auto &s : key.sets) {
+    MVKE::hashCombine(seed, static_cast<VkDescriptorSetLayout>(s));
+  }
+
+  for (const auto &r : key.ranges) {
+    MVKE::hashCombine(seed, static_cast<VkFlags>(r.stageFlags));
+    MVKE::hashCombine(seed, r.offset);
+    MVKE::hashCombine(seed, r.size);
+  }
+
+  return seed;
+}
+
+MVKE::LayoutCache::LayoutCache(MVKE::Instance &inst) : mInst(inst) {}
+
+vk::DescriptorSetLayout MVKE::LayoutCache::descriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings) {
+  SetKey key{bindings};
+
+  auto it = mSetLayouts.find(key);
+  if (it != mSetLayouts.end()) return *it->second;
+
+  auto layout = mInst.mDevice->device().createDescriptorSetLayoutUnique({
+    vk::DescriptorSetLayoutCreateFlags(),
+    static_cast<uint32_t>(bindings.size()),
+    bindings.data()
+  });
+
+  vk::DescriptorSetLayout handle = *layout;
+  mSetLayouts.emplace(std::move(key), std::move(layout));
+  return handle;
+}
+
+vk::PipelineLayout MVKE::LayoutCache::pipelineLayout(const std::vector<vk::DescriptorSetLayout> &sets, const std::vector<vk::PushConstantRange> &ranges) {
+  PipelineKey key{sets, ranges};
+
+  auto it = mPipelineLayouts.find(key);
+  if (it != mPipelineLayouts.end()) return *it->second;
+
+  auto layout = mInst.mDevice->device().createPipelineLayoutUnique({
+    vk::PipelineLayoutCreateFlags(),
+    static_cast<uint32_t>(sets.size()),
+    sets.data(),
+    static_cast<uint32_t>(ranges.size()),
+    ranges.data()
+  });
+
+  vk::PipelineLayout handle = *layout;
+  mSetLayoutsOf.emplace(static_cast<VkPipelineLayout>(handle), sets);
+  mPipelineLayouts.emplace(std::move(key), std::move(layout));
+  return handle;
+}
+
+const std::vector<vk::DescriptorSetLayout> &MVKE::LayoutCache::setLayouts(const vk::PipelineLayout &layout) const {
+  return mSetLayoutsOf.at(static_cast<VkPipelineLayout>(layout));
+}
+
+vk::PipelineLayout MVKE::LayoutCache::pipelineLayout(const std::vector<const MVKE::ShaderReflection *> &stages, const std::map<uint32_t, vk::DescriptorSetLayout> &overrides) {
+  std::map<uint32_t, std::map<uint32_t, vk::DescriptorSetLayoutBinding>> sets;
+  vk::PushConstantRange pushRange(vk::ShaderStageFlags(), 0, 0);
+
+  for (const auto *refl : stages) {
+    for (const auto &b : refl->bindings) {
+      if (overrides.count(b.set)) continue;
+
+      if (b.count == 0) {
+        throw std::runtime_error("Runtime-sized descriptor array needs an explicit set layout!");
+      }
+
+      auto &binding = sets[b.set][b.binding];
+      binding.binding = b.binding;
+      binding.descriptorType = b.type;
+      binding.descriptorCount = std::max(binding.descriptorCount, b.count);
+      binding.stageFlags |= refl->stage;
+    }
+
+    if (refl->pushConstantSize > 0) {
+      pushRange.stageFlags |= refl->stage;
+      pushRange.size = std::max(pushRange.size, refl->pushConstantSize);
+    }
+  }
+
+  uint32_t setCount = 0;
+  if (!sets.empty()) setCount = sets.rbegin()->first + 1;
+  if (!overrides.empty()) setCount = std::max(setCount, overrides.rbegin()->first + 1);
+
+  std::vector<vk::DescriptorSetLayout> layouts;
+
+  for (uint32_t i = 0; i < setCount; ++i) {
+    auto o = overrides.find(i);
+
+    if (o != overrides.end()) {
+      layouts.push_back(o->second);
+      continue;
+    }
+
+    std::vector<vk::DescriptorSetLayoutBinding> bindings;
+    for (const auto &b : sets[i]) {
+      bindings.push_back(b.second);
+    }
+
+    layouts.push_back(descriptorSetLayout(bindings));
+  }
+
+  std::vector<vk::PushConstantRange> ranges;
+  if (pushRange.size > 0) ranges.push_back(pushRange);
+
+  return pipelineLayout(layouts, ranges);
+}
+
+std::vector<vk::VertexInputAttributeDescription> MVKE::LayoutCache::vertexAttributes(const MVKE::ShaderReflection &vert, uint32_t binding, uint32_t &stride, uint32_t firstLocation, uint32_t endLocation) {
+  std::vector<vk::VertexInputAttributeDescription> attributes;
+  stride = 0;
+
+  for (const auto &input : vert.inputs) {
+    if (input.location < firstLocation || input.location >= endLocation) continue;
+    attributes.push_back({input.location, binding, input.format, stride});
+    stride += input.size;
+  }
+
+  return attributes;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  struct ShaderReflection {
+    struct Input {
+      uint32_t location;
+      vk::Format format;
+      uint32_t size;
+    };
+
+    struct Binding {
+      uint32_t set;
+      uint32_t binding;
+      vk::DescriptorType type;
+      // 0 for runtime-sized arrays, whose set layout must be supplied by the caller.
+      uint32_t count;
+    };
+
+    vk::ShaderStageFlagBits stage = vk::ShaderStageFlagBits::eVertex;
+    std::vector<Input> inputs;
+    std::vector<Binding> bindings;
+    uint32_t pushConstantSize = 0;
+    // Compute shaders only.
+    std::array<uint32_t, 3> localSize = {1, 1, 1};
+  };
+
+  // A minimal SPIR-V parser: reads entry point stage, input locations,
+  // descriptor bindings and the push constant block size from module words.
+  MVKE::ShaderReflection reflectSPIRV(const uint32_t *code, size_t size);
+
+  class LayoutCache {
+  public:
+    LayoutCache(MVKE::Instance &inst);
+
+    vk::DescriptorSetLayout descriptorSetLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings);
+    vk::PipelineLayout pipelineLayout(const std::vector<vk::DescriptorSetLayout> &sets, const std::vector<vk::PushConstantRange> &ranges);
+    vk::PipelineLayout pipelineLayout(const std::vector<const MVKE::ShaderReflection *> &stages, const std::map<uint32_t, vk::DescriptorSetLayout> &overrides = {});
+    const std::vector<vk::DescriptorSetLayout> &setLayouts(const vk::PipelineLayout &layout) const;
+
+    // Packs the inputs at locations [firstLocation, endLocation) into one
+    // binding, e.g. per-vertex and per-instance attributes into two.
+    static std::vector<vk::VertexInputAttributeDescription> vertexAttributes(const MVKE::ShaderReflection &vert, uint32_t binding, uint32_t &stride, uint32_t firstLocation = 0, uint32_t endLocation = UINT32_MAX);
+  private:
+    struct SetKey {
+      std::vector<vk::DescriptorSetLayoutBinding> bindings;
+      bool operator==(const SetKey &other) const;
+    };
+
+    struct PipelineKey {
+      std::vector<vk::DescriptorSetLayout> sets;
+      std::vector<vk::PushConstantRange> ranges;
+      bool operator==(const PipelineKey &other) const;
+    };
+
+    struct KeyHash {
+      size_t operator()(const SetKey &key) const;
+      size_t operator()(const PipelineKey &key) const;
+    };
+
+    MVKE::Instance &mInst;
+
+    std::unordered_map<SetKey, vk::UniqueDescriptorSetLayout, KeyHash> mSetLayouts;
+    std::unordered_map<PipelineKey, vk::UniquePipelineLayout, KeyHash> mPipelineLayouts;
+    std::unordered_map<VkPipelineLayout, std::vector<vk::DescriptorSetLayout>> mSetLayoutsOf;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,553 @@
+#include "rendergraph.hpp"
+#include "device.hpp"
+#include "image.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+using Access = MVKE::RenderGraph::Access;
+
+struct AccessInfo {
+  vk::ImageLayout layout;
+  vk::PipelineStageFlags stages;
+  vk::AccessFlags access;
+  vk::ImageUsageFlags imageUsage;
+  vk::BufferUsageFlags bufferUsage;
+  bool writable;
+};
+
+static const vk::PipelineStageFlags sShaderStages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+static const vk::PipelineStageFlags sDepthStages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+
+static const vk::AccessFlags sWriteAccess =
+  vk::AccessFlagBits::eShaderWrite
+  | vk::AccessFlagBits::eColorAttachmentWrite
+  | vk::AccessFlagBits::eDepthStencilAttachmentWrite
+  | vk::AccessFlagBits::eTransferWrite
+  | vk::AccessFlagBits::eHostWrite
+  | vk::AccessFlagBits::eMemoryWrite;
+
+static AccessInfo accessInfo(Access access) {
+  using Layout = vk::ImageLayout;
+  using Stage = vk::PipelineStageFlagBits;
+  using A = vk::AccessFlagBits;
+  using IU = vk::ImageUsageFlagBits;
+  using BU = vk::BufferUsageFlagBits;
+
+  switch (access) {
+  case Access::eColorAttachment:
+    return {Layout::eColorAttachmentOptimal, Stage::eColorAttachmentOutput, A::eColorAttachmentRead | A::eColorAttachmentWrite, IU::eColorAttachment, {}, true};
+  case Access::eDepthAttachment:
+    return {Layout::eDepthStencilAttachmentOptimal, sDepthStages, A::eDepthStencilAttachmentRead | A::eDepthStencilAttachmentWrite, IU::eDepthStencilAttachment, {}, true};
+  case Access::eDepthRead:
+    return {Layout::eDepthStencilReadOnlyOptimal, sDepthStages, A::eDepthStencilAttachmentRead, IU::eDepthStencilAttachment, {}, false};
+  case Access::eSampled:
+    return {Layout::eShaderReadOnlyOptimal, sShaderStages, A::eShaderRead, IU::eSampled, {}, false};
+  case Access::eStorageRead:
+    return {Layout::eGeneral, sShaderStages, A::eShaderRead, IU::eStorage, BU::eStorageBuffer, false};
+  case Access::eStorageWrite:
+    return {Layout::eGeneral, sShaderStages, A::eShaderRead | A::eShaderWrite, IU::eStorage, BU::eStorageBuffer, true};
+  case Access::eUniform:
+    return {Layout::eUndefined, sShaderStages, A::eUniformRead, {}, BU::eUniformBuffer, false};
+  case Access::eVertexBuffer:
+    return {Layout::eUndefined, Stage::eVertexInput, A::eVertexAttributeRead, {}, BU::eVertexBuffer, false};
+  case Access::eIndexBuffer:
+    return {Layout::eUndefined, Stage::eVertexInput, A::eIndexRead, {}, BU::eIndexBuffer, false};
+  case Access::eIndirect:
+    return {Layout::eUndefined, Stage::eDrawIndirect, A::eIndirectCommandRead, {}, BU::eIndirectBuffer, false};
+  case Access::eTransferSrc:
+    return {Layout::eTransferSrcOptimal, Stage::eTransfer, A::eTransferRead, IU::eTransferSrc, BU::eTransferSrc, false};
+  case Access::eTransferDst:
+    return {Layout::eTransferDstOptimal, Stage::eTransfer, A::eTransferWrite, IU::eTransferDst, BU::eTransferDst, true};
+  }
+
+  throw std::runtime_error("Unknown render graph access!");
+}
+
+static bool contains(vk::PipelineStageFlags set, vk::PipelineStageFlags flags) {
+  return (set & flags) == flags;
+}
+
+static bool contains(vk::AccessFlags set, vk::AccessFlags flags) {
+  return (set & flags) == flags;
+}
+
+MVKE::RenderGraph::PassBuilder::PassBuilder(MVKE::RenderGraph &graph, uint32_t pass) : mGraph(graph), mPass(pass) {}
+
+void MVKE::RenderGraph::PassBuilder::read(MVKE::RenderGraph::ResourceId id, MVKE::RenderGraph::Access access, vk::PipelineStageFlags stages) {
+  AccessInfo info = accessInfo(access);
+  const auto &res = mGraph.mResources.at(id);
+
+  if (res.isImage ? !info.imageUsage : !info.bufferUsage) {
+    throw std::runtime_error("Invalid access to render graph resource " + res.name + "!");
+  }
+
+  mGraph.mPasses[mPass].uses.push_back({id, access, stages ? stages : info.stages, false});
+}
+
+void MVKE::RenderGraph::PassBuilder::write(MVKE::RenderGraph::ResourceId id, MVKE::RenderGraph::Access access, vk::PipelineStageFlags stages) {
+  AccessInfo info = accessInfo(access);
+  const auto &res = mGraph.mResources.at(id);
+
+  if (!info.writable || (res.isImage ? !info.imageUsage : !info.bufferUsage)) {
+    throw std::runtime_error("Invalid write to render graph resource " + res.name + "!");
+  }
+
+  mGraph.mPasses[mPass].uses.push_back({id, access, stages ? stages : info.stages, true});
+}
+
+void MVKE::RenderGraph::PassBuilder::sideEffect() {
+  mGraph.mPasses[mPass].sideEffect = true;
+}
+
+MVKE::RenderGraph::RenderGraph(MVKE::Instance &inst) : mInst(inst) {}
+
+MVKE::RenderGraph::~RenderGraph() {
+  // Every image and buffer must go before the memory they alias.
+  mResources.clear();
+
+  for (auto mem : mMemory) {
+    vmaFreeMemory(mInst.mAllocator, mem);
+  }
+}
+
+MVKE::RenderGraph::ResourceId MVKE::RenderGraph::createImage(const std::string &name, const MVKE::RenderGraph::ImageDesc &desc) {
+  Resource res;
+  res.name = name;
+  res.isImage = true;
+  res.imported = false;
+  res.image = desc;
+
+  mResources.push_back(std::move(res));
+  return mResources.size() - 1;
+}
+
+MVKE::RenderGraph::ResourceId MVKE::RenderGraph::createBuffer(const std::string &name, const MVKE::RenderGraph::BufferDesc &desc) {
+  Resource res;
+  res.name = name;
+  res.isImage = false;
+  res.imported = false;
+  res.buffer = desc;
+
+  mResources.push_back(std::move(res));
+  return mResources.size() - 1;
+}
+
+MVKE::RenderGraph::ResourceId MVKE::RenderGraph::importImage(const std::string &name, const vk::Image &image, vk::Format format, vk::Extent2D extent, vk::ImageLayout initialLayout, vk::PipelineStageFlags initialStage, vk::AccessFlags initialAccess, vk::ImageLayout finalLayout, const vk::ImageView &view) {
+  Resource res;
+  res.name = name;
+  res.isImage = true;
+  res.imported = true;
+  res.image = {extent, format};
+  res.vkImage = image;
+  res.vkView = view;
+  res.initialLayout = initialLayout;
+  res.initialStage = initialStage;
+  res.initialAccess = initialAccess;
+  res.finalLayout = finalLayout;
+
+  mResources.push_back(std::move(res));
+  return mResources.size() - 1;
+}
+
+MVKE::RenderGraph::ResourceId MVKE::RenderGraph::importBuffer(const std::string &name, const vk::Buffer &buffer, vk::DeviceSize size, vk::PipelineStageFlags initialStage, vk::AccessFlags initialAccess) {
+  Resource res;
+  res.name = name;
+  res.isImage = false;
+  res.imported = true;
+  res.buffer = {size, vk::BufferUsageFlags()};
+  res.vkBuffer = buffer;
+  res.initialStage = initialStage;
+  res.initialAccess = initialAccess;
+
+  mResources.push_back(std::move(res));
+  return mResources.size() - 1;
+}
+
+void MVKE::RenderGraph::addPass(const std::string &name, const MVKE::RenderGraph::Setup &setup, const MVKE::RenderGraph::Execute &execute) {
+  if (mCompiled) {
+    throw std::runtime_error("Render graph is already compiled!");
+  }
+
+  mPasses.push_back({name, execute});
+
+  PassBuilder builder(*this, mPasses.size() - 1);
+  setup(builder);
+}
+
+void MVKE::RenderGraph::compile() {
+  if (mCompiled) return;
+
+  cull();
+  allocate();
+  plan();
+
+  mCompiled = true;
+
+  std::cout << "Render graph: " << mStats.passes << " passes (" << mStats.culled << " culled), "
+    << mStats.barriers << " barriers, "
+    << (mStats.allocatedBytes >> 10) << "/" << (mStats.transientBytes >> 10) << "KiB transient memory" << std::endl;
+}
+
+// Walks the passes backwards from the imported resources. A pass lives if
+// it writes something a later live pass (or the outside world) needs.
+void MVKE::RenderGraph::cull() {
+  std::vector<bool> needed(mResources.size());
+
+  for (size_t i = 0; i < mResources.size(); ++i) {
+    needed[i] = mResources[i].imported;
+  }
+
+  for (size_t i = mPasses.size(); i-- > 0;) {
+    Pass &pass = mPasses[i];
+
+    pass.live = pass.sideEffect || std::any_of(pass.uses.begin(), pass.uses.end(), [&](const Use &u) {
+      return u.write && needed[u.resource];
+    });
+
+    if (!pass.live) {
+      ++mStats.culled;
+      continue;
+    }
+
+    // Writes stay needed too: an attachment may be loaded rather than
+    // cleared, so earlier writers of it must survive.
+    for (const auto &u : pass.uses) {
+      needed[u.resource] = true;
+    }
+
+    ++mStats.passes;
+  }
+
+  for (size_t i = 0; i < mPasses.size(); ++i) {
+    if (!mPasses[i].live) continue;
+
+    for (const auto &u : mPasses[i].uses) {
+      Resource &res = mResources[u.resource];
+      if (res.first < 0) res.first = i;
+      res.last = i;
+    }
+  }
+}
+
+// Creates the transient resources and packs them into as few allocations as
+// their lifetimes allow. Resources sharing an allocation all start at its
+// beginning; the barrier plan orders each after the one before it.
+void MVKE::RenderGraph::allocate() {
+  struct Block {
+    bool isImage;
+    VkMemoryRequirements reqs;
+    std::vector<ResourceId> users;
+  };
+
+  std::vector<ResourceId> transients;
+  std::vector<VkMemoryRequirements> reqs(mResources.size());
+
+  for (size_t i = 0; i < mResources.size(); ++i) {
+    Resource &res = mResources[i];
+    if (res.imported || res.first < 0) continue;
+
+    vk::ImageUsageFlags imageUsage = res.image.usage;
+    vk::BufferUsageFlags bufferUsage = res.buffer.usage;
+
+    for (const auto &pass : mPasses) {
+      if (!pass.live) continue;
+
+      for (const auto &u : pass.uses) {
+        if (u.resource != i) continue;
+        imageUsage |= accessInfo(u.access).imageUsage;
+        bufferUsage |= accessInfo(u.access).bufferUsage;
+      }
+    }
+
+    if (res.isImage) {
+      vk::ImageCreateInfo imageInfo(
+        vk::ImageCreateFlags(),
+        vk::ImageType::e2D,
+        res.image.format,
+        vk::Extent3D(res.image.extent.width, res.image.extent.height, 1),
+        1,
+        1,
+        res.image.samples,
+        vk::ImageTiling::eOptimal,
+        imageUsage,
+        vk::SharingMode::eExclusive,
+        0,
+        nullptr,
+        vk::ImageLayout::eUndefined
+      );
+
+      res.ownedImage = mInst.mDevice->device().createImageUnique(imageInfo);
+      res.vkImage = *res.ownedImage;
+      reqs[i] = mInst.mDevice->device().getImageMemoryRequirements(res.vkImage);
+    } else {
+      vk::BufferCreateInfo bufferInfo(
+        vk::BufferCreateFlags(),
+        res.buffer.size,
+        bufferUsage,
+        vk::SharingMode::eExclusive
+      );
+
+      res.ownedBuffer = mInst.mDevice->device().createBufferUnique(bufferInfo);
+      res.vkBuffer = *res.ownedBuffer;
+      reqs[i] = mInst.mDevice->device().getBufferMemoryRequirements(res.vkBuffer);
+    }
+
+    mStats.transientBytes += reqs[i].size;
+    transients.push_back(i);
+  }
+
+  // Largest first, so smaller resources fill in behind them.
+  std::sort(transients.begin(), transients.end(), [&](ResourceId a, ResourceId b) {
+    return reqs[a].size > reqs[b].size;
+  });
+
+  std::vector<Block> blocks;
+
+  for (ResourceId id : transients) {
+    const Resource &res = mResources[id];
+    Block *fit = nullptr;
+
+    for (auto &block : blocks) {
+      if (block.isImage != res.isImage) continue;
+      if (!(block.reqs.memoryTypeBits & reqs[id].memoryTypeBits)) continue;
+
+      bool overlaps = std::any_of(block.users.begin(), block.users.end(), [&](ResourceId other) {
+        return mResources[other].first <= res.last && res.first <= mResources[other].last;
+      });
+
+      if (!overlaps) {
+        fit = &block;
+        break;
+      }
+    }
+
+    if (!fit) {
+      blocks.push_back({res.isImage, reqs[id], {}});
+      fit = &blocks.back();
+    }
+
+    fit->reqs.size = std::max(fit->reqs.size, reqs[id].size);
+    fit->reqs.alignment = std::max(fit->reqs.alignment, reqs[id].alignment);
+    fit->reqs.memoryTypeBits &= reqs[id].memoryTypeBits;
+    fit->users.push_back(id);
+  }
+
+  for (auto &block : blocks) {
+    VmaAllocationCreateInfo createInfo = {};
+    createInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VmaAllocation mem;
+
+    if (vmaAllocateMemory(mInst.mAllocator, &block.reqs, &createInfo, &mem, nullptr) != VK_SUCCESS) {
+      throw std::runtime_error("Failed to allocate render graph memory!");
+    }
+
+    mMemory.push_back(mem);
+    mStats.allocatedBytes += block.reqs.size;
+
+    std::sort(block.users.begin(), block.users.end(), [&](ResourceId a, ResourceId b) {
+      return mResources[a].first < mResources[b].first;
+    });
+
+    for (size_t i = 0; i < block.users.size(); ++i) {
+      Resource &res = mResources[block.users[i]];
+
+      // The first user follows the last one from the previous frame.
+      res.alias = block.users[i == 0 ? block.users.size() - 1 : i - 1];
+
+      if (res.isImage) {
+        vmaBindImageMemory(mInst.mAllocator, mem, res.vkImage);
+
+        vk::ImageViewCreateInfo viewInfo(
+          vk::ImageViewCreateFlags(),
+          res.vkImage,
+          vk::ImageViewType::e2D,
+          res.image.format,
+          vk::ComponentMapping(),
+          vk::ImageSubresourceRange(MVKE::Image::aspectFor(res.image.format), 0, 1, 0, 1)
+        );
+
+        res.ownedView = mInst.mDevice->device().createImageViewUnique(viewInfo);
+        res.vkView = *res.ownedView;
+      } else {
+        vmaBindBufferMemory(mInst.mAllocator, mem, res.vkBuffer);
+      }
+    }
+  }
+}
+
+// Simulates the frame, tracking for each resource its layout, the last
+// write, the reads since and which stages have already been made to wait
+// for that write. A barrier is only emitted where an access is not covered.
+void MVKE::RenderGraph::plan() {
+  struct State {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags writeStages;
+    vk::AccessFlags writeAccess;
+    vk::PipelineStageFlags readStages;
+    vk::PipelineStageFlags syncedStages;
+    vk::AccessFlags syncedAccess;
+  };
+
+  std::vector<State> states(mResources.size());
+
+  for (size_t i = 0; i < mResources.size(); ++i) {
+    const Resource &res = mResources[i];
+    State &st = states[i];
+
+    if (res.imported) {
+      st.layout = res.initialLayout;
+      st.writeStages = res.initialStage;
+      st.writeAccess = res.initialAccess & sWriteAccess;
+    } else if (res.alias >= 0) {
+      // Whatever last touched this memory must finish first.
+      const Resource &prev = mResources[res.alias];
+
+      for (const auto &u : mPasses[prev.last].uses) {
+        if (u.resource != static_cast<ResourceId>(res.alias)) continue;
+        st.writeStages |= u.stages;
+        st.writeAccess |= accessInfo(u.access).access & sWriteAccess;
+      }
+    }
+  }
+
+  auto emit = [&](Barriers &b, ResourceId id, State &st, vk::ImageLayout layout, vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess) {
+    const Resource &res = mResources[id];
+
+    vk::PipelineStageFlags src = st.writeStages | st.readStages;
+    b.src |= src ? src : vk::PipelineStageFlagBits::eTopOfPipe;
+    b.dst |= dstStages;
+
+    if (res.isImage) {
+      b.images.push_back(vk::ImageMemoryBarrier(
+        st.writeAccess,
+        dstAccess,
+        st.layout,
+        layout,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        res.vkImage,
+        vk::ImageSubresourceRange(MVKE::Image::aspectFor(res.image.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS)
+      ));
+    } else {
+      b.buffers.push_back(vk::BufferMemoryBarrier(
+        st.writeAccess,
+        dstAccess,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        res.vkBuffer,
+        0,
+        VK_WHOLE_SIZE
+      ));
+    }
+  };
+
+  mBarriers.resize(mPasses.size());
+
+  for (size_t p = 0; p < mPasses.size(); ++p) {
+    if (!mPasses[p].live) continue;
+
+    // Merge repeated uses of one resource within the pass.
+    std::map<ResourceId, Use> merged;
+    std::map<ResourceId, AccessInfo> infos;
+
+    for (const auto &u : mPasses[p].uses) {
+      AccessInfo info = accessInfo(u.access);
+      auto it = merged.find(u.resource);
+
+      if (it == merged.end()) {
+        merged.emplace(u.resource, u);
+        infos.emplace(u.resource, info);
+        continue;
+      }
+
+      AccessInfo &prev = infos[u.resource];
+      it->second.stages |= u.stages;
+      prev.access |= info.access;
+
+      if (u.write && !it->second.write) {
+        prev.layout = info.layout;
+        it->second.write = true;
+      }
+    }
+
+    Barriers &b = mBarriers[p];
+
+    for (const auto &m : merged) {
+      const Resource &res = mResources[m.first];
+      const Use &u = m.second;
+      const AccessInfo &info = infos[m.first];
+      State &st = states[m.first];
+
+      bool relayout = res.isImage && st.layout != info.layout;
+
+      if (u.write) {
+        emit(b, m.first, st, info.layout, u.stages, info.access);
+        st.writeStages = u.stages;
+        st.writeAccess = info.access & sWriteAccess;
+        st.readStages = vk::PipelineStageFlags();
+        st.syncedStages = vk::PipelineStageFlags();
+        st.syncedAccess = vk::AccessFlags();
+      } else if (relayout || (st.writeStages && !(contains(st.syncedStages, u.stages) && contains(st.syncedAccess, info.access)))) {
+        emit(b, m.first, st, info.layout, u.stages, info.access);
+
+        // The transition itself counts as a write later readers wait on.
+        if (relayout) {
+          st.writeStages = u.stages;
+          st.syncedStages = vk::PipelineStageFlags();
+          st.syncedAccess = vk::AccessFlags();
+        }
+
+        st.readStages |= u.stages;
+        st.syncedStages |= u.stages;
+        st.syncedAccess |= info.access;
+      } else {
+        st.readStages |= u.stages;
+      }
+
+      if (res.isImage) st.layout = info.layout;
+    }
+
+    if (b.src) ++mStats.barriers;
+  }
+
+  for (size_t i = 0; i < mResources.size(); ++i) {
+    const Resource &res = mResources[i];
+
+    if (!res.imported || !res.isImage) continue;
+    if (res.finalLayout == vk::ImageLayout::eUndefined || res.finalLayout == states[i].layout) continue;
+
+    emit(mFinal, i, states[i], res.finalLayout, vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlags());
+  }
+
+  if (mFinal.src) ++mStats.barriers;
+}
+
+void MVKE::RenderGraph::record(const vk::CommandBuffer &cmd, const MVKE::RenderGraph::Barriers &barriers) const {
+  if (!barriers.src) return;
+
+  cmd.pipelineBarrier(barriers.src, barriers.dst, vk::DependencyFlags(), {}, barriers.buffers, barriers.images, mInst.mDevice->dispatch());
+}
+
+void MVKE::RenderGraph::execute(const vk::CommandBuffer &cmd) const {
+  if (!mCompiled) {
+    throw std::runtime_error("Render graph executed before compile!");
+  }
+
+  for (size_t i = 0; i < mPasses.size(); ++i) {
+    if (!mPasses[i].live) continue;
+
+    record(cmd, mBarriers[i]);
+    mPasses[i].execute(cmd);
+  }
+
+  record(cmd, mFinal);
+}
+
+const vk::Image &MVKE::RenderGraph::image(MVKE::RenderGraph::ResourceId id) const { return mResources.at(id).vkImage; }
+const vk::ImageView &MVKE::RenderGraph::view(MVKE::RenderGraph::ResourceId id) const { return mResources.at(id).vkView; }
+const vk::Buffer &MVKE::RenderGraph::buffer(MVKE::RenderGraph::ResourceId id) const { return mResources.at(id).vkBuffer; }
+
+const MVKE::RenderGraph::Stats &MVKE::RenderGraph::stats() const { return mStats; }
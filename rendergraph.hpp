@@ -0,0 +1,167 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // A frame described as passes that declare which images and buffers they
+  // read and write. compile() culls passes whose results are never used,
+  // derives the pipeline barriers and layout transitions between the rest,
+  // and places transient resources whose lifetimes do not overlap in the
+  // same memory. execute() then records the frame into a command buffer.
+  //
+  // Imported resources (the swapchain image, long-lived buffers) are the
+  // graph's outputs: any pass writing one is kept.
+  class RenderGraph {
+  public:
+    using ResourceId = uint32_t;
+
+    enum class Access {
+      eColorAttachment,
+      eDepthAttachment,
+      eDepthRead,
+      eSampled,
+      eStorageRead,
+      eStorageWrite,
+      eUniform,
+      eVertexBuffer,
+      eIndexBuffer,
+      eIndirect,
+      eTransferSrc,
+      eTransferDst,
+    };
+
+    struct ImageDesc {
+      vk::Extent2D extent;
+      vk::Format format;
+      vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+      // Added to the usage derived from the passes' accesses.
+      vk::ImageUsageFlags usage;
+    };
+
+    struct BufferDesc {
+      vk::DeviceSize size;
+      vk::BufferUsageFlags usage;
+    };
+
+    struct Stats {
+      uint32_t passes = 0;
+      uint32_t culled = 0;
+      uint32_t barriers = 0;
+      uint64_t transientBytes = 0;
+      uint64_t allocatedBytes = 0;
+    };
+
+    class PassBuilder {
+      friend RenderGraph;
+    public:
+      // stages narrows the default stages for the access, e.g. a texture
+      // only sampled by the fragment shader.
+      void read(ResourceId id, Access access, vk::PipelineStageFlags stages = vk::PipelineStageFlags());
+      void write(ResourceId id, Access access, vk::PipelineStageFlags stages = vk::PipelineStageFlags());
+      // Keep the pass even when nothing reads what it writes.
+      void sideEffect();
+    private:
+      PassBuilder(RenderGraph &graph, uint32_t pass);
+
+      RenderGraph &mGraph;
+      uint32_t mPass;
+    };
+
+    using Setup = std::function<void(PassBuilder &)>;
+    using Execute = std::function<void(const vk::CommandBuffer &)>;
+
+    RenderGraph(MVKE::Instance &inst);
+    ~RenderGraph();
+
+    ResourceId createImage(const std::string &name, const ImageDesc &desc);
+    ResourceId createBuffer(const std::string &name, const BufferDesc &desc);
+    // initialStage and initialAccess describe the last use before the graph,
+    // such as the previous frame's writes, which the first barrier must make
+    // available.
+    ResourceId importImage(const std::string &name, const vk::Image &image, vk::Format format, vk::Extent2D extent, vk::ImageLayout initialLayout, vk::PipelineStageFlags initialStage, vk::AccessFlags initialAccess, vk::ImageLayout finalLayout, const vk::ImageView &view = vk::ImageView());
+    ResourceId importBuffer(const std::string &name, const vk::Buffer &buffer, vk::DeviceSize size, vk::PipelineStageFlags initialStage = vk::PipelineStageFlags(), vk::AccessFlags initialAccess = vk::AccessFlags());
+
+    void addPass(const std::string &name, const Setup &setup, const Execute &execute);
+
+    void compile();
+    void execute(const vk::CommandBuffer &cmd) const;
+
+    const vk::Image &image(ResourceId id) const;
+    const vk::ImageView &view(ResourceId id) const;
+    const vk::Buffer &buffer(ResourceId id) const;
+
+    const Stats &stats() const;
+  private:
+    struct Use {
+      ResourceId resource;
+      Access access;
+      vk::PipelineStageFlags stages;
+      bool write;
+    };
+
+    struct Pass {
+      std::string name;
+      Execute execute;
+      std::vector<Use> uses;
+      bool sideEffect = false;
+      bool live = false;
+    };
+
+    struct Resource {
+      std::string name;
+      bool isImage;
+      bool imported;
+
+      ImageDesc image;
+      BufferDesc buffer;
+
+      vk::Image vkImage;
+      vk::ImageView vkView;
+      vk::Buffer vkBuffer;
+      vk::UniqueImage ownedImage;
+      vk::UniqueImageView ownedView;
+      vk::UniqueBuffer ownedBuffer;
+
+      vk::ImageLayout initialLayout = vk::ImageLayout::eUndefined;
+      vk::PipelineStageFlags initialStage;
+      vk::AccessFlags initialAccess;
+      vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+
+      int first = -1;
+      int last = -1;
+      // The transient that used this memory before us, possibly last frame.
+      int alias = -1;
+    };
+
+    struct Barriers {
+      vk::PipelineStageFlags src;
+      vk::PipelineStageFlags dst;
+      std::vector<vk::ImageMemoryBarrier> images;
+      std::vector<vk::BufferMemoryBarrier> buffers;
+    };
+
+    void cull();
+    void allocate();
+    void plan();
+    void record(const vk::CommandBuffer &cmd, const Barriers &barriers) const;
+
+    MVKE::Instance &mInst;
+
+    std::vector<Resource> mResources;
+    std::vector<Pass> mPasses;
+
+    std::vector<VmaAllocation> mMemory;
+    // One batch before each pass, plus the final transitions to finalLayout.
+    std::vector<Barriers> mBarriers;
+    Barriers mFinal;
+
+    bool mCompiled = false;
+
+    Stats mStats;
+  };
+}
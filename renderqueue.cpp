@@ -0,0 +1,232 @@
+#include "renderqueue.hpp"
+
+#include <algorithm>
+
+static uint64_t quantizeDepth(float depth) {
+  return static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * 0xfffff);
+}
+
+uint64_t MVKE::RenderQueue::opaqueKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+  return (uint64_t(pass & 0xf) << 60)
+    | (uint64_t(pipeline & 0xfff) << 48)
+    | (uint64_t(material & 0xffff) << 32)
+    | (uint64_t(mesh & 0xfff) << 20)
+    | quantizeDepth(depth);
+}
+
+uint64_t MVKE::RenderQueue::blendedKey(uint32_t pass, float depth, uint32_t pipeline, uint32_t material, uint32_t mesh) {
+  return (uint64_t(pass & 0xf) << 60)
+    | ((0xfffff - quantizeDepth(depth)) << 40)
+    | (uint64_t(pipeline & 0xfff) << 28)
+    | (uint64_t(material & 0xffff) << 12)
+    | uint64_t(mesh & 0xfff);
+}
+
+MVKE::RenderQueue::RenderQueue(unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+  }
+
+  mHistograms.resize(threads);
+
+  // The calling thread takes the first share of every job.
+  for (unsigned i = 1; i < threads; ++i) {
+    mThreads.emplace_back(&MVKE::RenderQueue::workLoop, this, i);
+  }
+
+  mBuildStart = std::chrono::high_resolution_clock::now();
+}
+
+MVKE::RenderQueue::~RenderQueue() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+
+  mCond.notify_all();
+
+  for (auto &t : mThreads) {
+    t.join();
+  }
+}
+
+void MVKE::RenderQueue::clear() {
+  mItems.clear();
+  mDraws.clear();
+  mSorted = false;
+  mBuildStart = std::chrono::high_resolution_clock::now();
+}
+
+void MVKE::RenderQueue::push(uint64_t key, const Draw &draw) {
+  mItems.push_back({key, static_cast<uint32_t>(mDraws.size())});
+  mDraws.push_back(draw);
+  mSorted = false;
+}
+
+// Least significant digit first, eight bits at a time. Each pass builds a
+// histogram per thread over its share of the items, turns them into
+// scatter offsets that keep the sort stable, and scatters in parallel.
+// Digits every key shares, such as unused pass bits, are skipped.
+void MVKE::RenderQueue::sort() {
+  auto start = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> build = start - mBuildStart;
+
+  size_t count = mItems.size();
+  unsigned jobs = count >= sParallelThreshold ? mHistograms.size() : 1;
+  size_t share = (count + jobs - 1) / jobs;
+
+  mScratch.resize(count);
+
+  Item *src = mItems.data();
+  Item *dst = mScratch.data();
+
+  for (unsigned shift = 0; shift < 64; shift += 8) {
+    parallel(jobs, [&](unsigned job) {
+      Histogram &h = mHistograms[job];
+      h.fill(0);
+
+      size_t end = std::min(count, (job + 1) * share);
+
+      for (size_t i = job * share; i < end; ++i) {
+        ++h[(src[i].key >> shift) & 0xff];
+      }
+    });
+
+    bool trivial = false;
+    uint32_t offset = 0;
+
+    for (unsigned digit = 0; digit < 256; ++digit) {
+      uint32_t total = 0;
+
+      for (unsigned job = 0; job < jobs; ++job) {
+        uint32_t n = mHistograms[job][digit];
+        mHistograms[job][digit] = offset + total;
+        total += n;
+      }
+
+      if (total == count) trivial = true;
+      offset += total;
+    }
+
+    if (trivial) continue;
+
+    parallel(jobs, [&](unsigned job) {
+      Histogram &h = mHistograms[job];
+      size_t end = std::min(count, (job + 1) * share);
+
+      for (size_t i = job * share; i < end; ++i) {
+        dst[h[(src[i].key >> shift) & 0xff]++] = src[i];
+      }
+    });
+
+    std::swap(src, dst);
+  }
+
+  if (src != mItems.data()) {
+    mItems.swap(mScratch);
+  }
+
+  mSorted = true;
+  ++mVersion;
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+  mStats.draws = count;
+  mStats.buildMillis = build.count();
+  mStats.sortMillis = elapsed.count();
+}
+
+void MVKE::RenderQueue::record(const vk::CommandBuffer &cmd, const vk::DispatchLoaderDynamic &dispatch) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  if (!mSorted) sort();
+
+  vk::Pipeline pipeline;
+  vk::DescriptorSet material;
+  vk::Buffer vertexBuffer;
+  vk::Buffer indexBuffer;
+
+  mStats.pipelineBinds = 0;
+  mStats.descriptorBinds = 0;
+
+  for (const auto &item : mItems) {
+    const Draw &d = mDraws[item.payload];
+
+    if (d.pipeline != pipeline) {
+      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, d.pipeline, dispatch);
+      pipeline = d.pipeline;
+      // A new layout may disturb the bound set.
+      material = vk::DescriptorSet();
+      ++mStats.pipelineBinds;
+    }
+
+    if (d.material && d.material != material) {
+      cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, d.layout, 0, d.material, {}, dispatch);
+      material = d.material;
+      ++mStats.descriptorBinds;
+    }
+
+    if (d.vertexBuffer != vertexBuffer) {
+      cmd.bindVertexBuffers(0, {d.vertexBuffer}, {0}, dispatch);
+      vertexBuffer = d.vertexBuffer;
+    }
+
+    if (d.indexBuffer != indexBuffer) {
+      cmd.bindIndexBuffer(d.indexBuffer, 0, d.indexType, dispatch);
+      indexBuffer = d.indexBuffer;
+    }
+
+    cmd.drawIndexed(d.indexCount, d.instanceCount, d.firstIndex, d.vertexOffset, d.firstInstance, dispatch);
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+  mStats.recordMillis = elapsed.count();
+}
+
+void MVKE::RenderQueue::parallel(unsigned jobs, const std::function<void(unsigned)> &job) {
+  if (jobs > 1) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mJob = &job;
+    mJobs = jobs;
+    mPending = mThreads.size();
+    ++mGeneration;
+  }
+
+  if (jobs > 1) mCond.notify_all();
+
+  job(0);
+
+  if (jobs > 1) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mPending == 0; });
+    mJob = nullptr;
+  }
+}
+
+void MVKE::RenderQueue::workLoop(unsigned index) {
+  uint64_t seen = 0;
+
+  for (;;) {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCond.wait(lock, [&] { return mStopping || mGeneration != seen; });
+
+    if (mStopping) return;
+
+    seen = mGeneration;
+    const auto *job = mJob;
+    bool active = index < mJobs;
+    lock.unlock();
+
+    if (active) (*job)(index);
+
+    lock.lock();
+    if (--mPending == 0) mDone.notify_one();
+  }
+}
+
+bool MVKE::RenderQueue::sorted() const { return mSorted; }
+uint64_t MVKE::RenderQueue::version() const { return mVersion; }
+size_t MVKE::RenderQueue::size() const { return mItems.size(); }
+uint64_t MVKE::RenderQueue::key(size_t i) const { return mItems[i].key; }
+const MVKE::RenderQueue::Draw &MVKE::RenderQueue::draw(size_t i) const { return mDraws[mItems[i].payload]; }
+const MVKE::RenderQueue::Stats &MVKE::RenderQueue::stats() const { return mStats; }
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // Draws submitted as a 64-bit sort key and a payload. Sorting the keys
+  // groups draws by pass, then pipeline, material and mesh, so state is only
+  // rebound when it changes, and orders opaque draws front to back.
+  class RenderQueue {
+  public:
+    struct Draw {
+      vk::Pipeline pipeline;
+      vk::PipelineLayout layout;
+      // Bound to set 0 when not null.
+      vk::DescriptorSet material;
+      vk::Buffer vertexBuffer;
+      vk::Buffer indexBuffer;
+      vk::IndexType indexType = vk::IndexType::eUint16;
+      uint32_t indexCount = 0;
+      uint32_t instanceCount = 1;
+      uint32_t firstIndex = 0;
+      int32_t vertexOffset = 0;
+      uint32_t firstInstance = 0;
+    };
+
+    struct Stats {
+      uint32_t draws = 0;
+      uint32_t pipelineBinds = 0;
+      uint32_t descriptorBinds = 0;
+      // From clear() to sort().
+      double buildMillis = 0.0;
+      double sortMillis = 0.0;
+      double recordMillis = 0.0;
+    };
+
+    // pass:4 | pipeline:12 | material:16 | mesh:12 | depth:20, with depth in
+    // [0, 1] ascending so nearer draws come first within a mesh.
+    static uint64_t opaqueKey(uint32_t pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+    // pass:4 | depth:20 | pipeline:12 | material:16 | mesh:12, with depth
+    // inverted so blended draws go back to front before any state grouping.
+    static uint64_t blendedKey(uint32_t pass, float depth, uint32_t pipeline, uint32_t material, uint32_t mesh);
+
+    RenderQueue(unsigned threads = 0);
+    ~RenderQueue();
+
+    void clear();
+    void push(uint64_t key, const Draw &draw);
+    // Radix sorts the keys; bumps version() so recorded frames go stale.
+    void sort();
+    // Recorded through the device's dispatch table, since a large queue is
+    // the most calls any frame makes.
+    void record(const vk::CommandBuffer &cmd, const vk::DispatchLoaderDynamic &dispatch);
+
+    bool sorted() const;
+    uint64_t version() const;
+    size_t size() const;
+    // The i-th draw and its key, in sorted order once sort() has run.
+    uint64_t key(size_t i) const;
+    const Draw &draw(size_t i) const;
+    const Stats &stats() const;
+
+    // Below this many draws the sort stays on the calling thread.
+    static const size_t sParallelThreshold = 4096;
+  private:
+    struct Item {
+      uint64_t key;
+      uint32_t payload;
+    };
+
+    using Histogram = std::array<uint32_t, 256>;
+
+    // Runs job(0 .. jobs - 1), the first on the calling thread.
+    void parallel(unsigned jobs, const std::function<void(unsigned)> &job);
+    void workLoop(unsigned index);
+
+    std::vector<Item> mItems;
+    std::vector<Item> mScratch;
+    std::vector<Draw> mDraws;
+    std::vector<Histogram> mHistograms;
+
+    bool mSorted = true;
+    uint64_t mVersion = 0;
+
+    std::chrono::high_resolution_clock::time_point mBuildStart;
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::condition_variable mDone;
+    const std::function<void(unsigned)> *mJob = nullptr;
+    unsigned mJobs = 0;
+    unsigned mPending = 0;
+    uint64_t mGeneration = 0;
+    bool mStopping = false;
+    std::vector<std::thread> mThreads;
+
+    Stats mStats;
+  };
+}
@@ -0,0 +1,95 @@
+#include "shader.hpp"
+#include "device.hpp"
+
+#include <cstring>
+
+#include "shader.vert.h"
+#include "shader.frag.h"
+#include "depth.vert.h"
+#include "cull.comp.h"
+#include "instanced.vert.h"
+#include "static.vert.h"
+#include "sprite.vert.h"
+#include "sprite.frag.h"
+#include "debug.vert.h"
+#include "debug.frag.h"
+
+static const MVKE::ShaderCode sEmbedded[] = {
+  {"shader.vert", shader_vert, sizeof shader_vert},
+  {"shader.frag", shader_frag, sizeof shader_frag},
+  {"depth.vert", depth_vert, sizeof depth_vert},
+  {"cull.comp", cull_comp, sizeof cull_comp},
+  {"instanced.vert", instanced_vert, sizeof instanced_vert},
+  {"static.vert", static_vert, sizeof static_vert},
+  {"sprite.vert", sprite_vert, sizeof sprite_vert},
+  {"sprite.frag", sprite_frag, sizeof sprite_frag},
+  {"debug.vert", debug_vert, sizeof debug_vert},
+  {"debug.frag", debug_frag, sizeof debug_frag},
+};
+
+const MVKE::ShaderCode *MVKE::findEmbeddedShader(const std::string &name) {
+  for (const auto &s : sEmbedded) {
+    if (name == s.name) return &s;
+  }
+
+  return nullptr;
+}
+
+MVKE::ShaderRegistry::ShaderRegistry(MVKE::Instance &inst) : mInst(inst) {}
+
+MVKE::ShaderRegistry::Entry &MVKE::ShaderRegistry::load(const std::string &name) {
+  auto it = mModules.find(name);
+
+  if (it != mModules.end()) {
+    return it->second;
+  }
+
+  const MVKE::ShaderCode *code = findEmbeddedShader(name);
+
+  if (!code) {
+    throw std::runtime_error("Unknown shader " + name + "!");
+  }
+
+  vk::ShaderModuleCreateInfo createInfo(
+    vk::ShaderModuleCreateFlags(),
+    code->size,
+    code->code
+  );
+
+  Entry entry{
+    mInst.mDevice->device().createShaderModuleUnique(createInfo),
+    MVKE::reflectSPIRV(code->code, code->size)
+  };
+
+  return mModules.emplace(name, std::move(entry)).first->second;
+}
+
+vk::ShaderModule MVKE::ShaderRegistry::get(const std::string &name) {
+  return *load(name).module;
+}
+
+const MVKE::ShaderReflection &MVKE::ShaderRegistry::reflection(const std::string &name) {
+  return load(name).reflection;
+}
+
+// Swaps in new code for a shader, handing back the old module so the caller
+// can keep it alive until nothing in flight uses it.
+vk::UniqueShaderModule MVKE::ShaderRegistry::replace(const std::string &name, const std::vector<uint32_t> &code) {
+  vk::ShaderModuleCreateInfo createInfo(
+    vk::ShaderModuleCreateFlags(),
+    code.size() * sizeof code[0],
+    code.data()
+  );
+
+  // Both may throw, so the entry is only touched once they have succeeded.
+  MVKE::ShaderReflection reflection = MVKE::reflectSPIRV(code.data(), code.size() * sizeof code[0]);
+  vk::UniqueShaderModule module = mInst.mDevice->device().createShaderModuleUnique(createInfo);
+
+  Entry &entry = mModules[name];
+
+  vk::UniqueShaderModule old = std::move(entry.module);
+  entry.module = std::move(module);
+  entry.reflection = std::move(reflection);
+
+  return old;
+}
\ No newline at end of file
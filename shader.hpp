@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mvke.hpp"
+#include "reflect.hpp"
+
+namespace MVKE {
+  struct ShaderCode {
+    const char *name;
+    const uint32_t *code;
+    size_t size;
+  };
+
+  // SPIR-V compiled into the library, looked up by source file name
+  // (e.g. "shader.vert"). Returns nullptr for unknown names.
+  const MVKE::ShaderCode *findEmbeddedShader(const std::string &name);
+
+  class ShaderRegistry {
+  public:
+    ShaderRegistry(MVKE::Instance &inst);
+    vk::ShaderModule get(const std::string &name);
+    vk::UniqueShaderModule replace(const std::string &name, const std::vector<uint32_t> &code);
+    const MVKE::ShaderReflection &reflection(const std::string &name);
+  private:
+    struct Entry {
+      vk::UniqueShaderModule module;
+      MVKE::ShaderReflection reflection;
+    };
+
+    Entry &load(const std::string &name);
+
+    MVKE::Instance &mInst;
+
+    std::unordered_map<std::string, Entry> mModules;
+  };
+}
\ No newline at end of file
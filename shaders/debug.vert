@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Already in clip space; the transform is applied when a line is added.
+layout(location = 0) in vec4 inPosition;
+// Unpacked from RGBA8 by the vertex fetch.
+layout(location = 1) in vec4 inColor;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+  gl_Position = inPosition;
+  fragColor = inColor;
+}
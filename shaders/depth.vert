@@ -0,0 +1,11 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+
+// Must match shader.vert bit for bit, or the main pass's EQUAL test fails.
+invariant gl_Position;
+
+void main() {
+  gl_Position = vec4(inPosition, 0.0, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Per vertex, binding 0.
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+// Per instance, binding 1. The matrix takes locations 2 to 5.
+layout(location = 2) in mat4 instTransform;
+layout(location = 6) in vec4 instColor;
+layout(location = 7) in uint instId;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+  gl_Position = instTransform * vec4(inPosition, 0.0, 1.0);
+  fragColor = inColor * instColor.rgb;
+}
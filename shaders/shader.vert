@@ -6,6 +6,8 @@ layout(location = 1) in vec3 inColor;
 
 layout(location = 0) out vec3 fragColor;
 
+invariant gl_Position;
+
 void main() {
   gl_Position = vec4(inPosition, 0.0, 1.0);
   fragColor = inColor;
@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec2 inUV;
+// Unpacked from RGBA8 by the vertex fetch.
+layout(location = 2) in vec4 inColor;
+
+// Pixels to clip space.
+layout(push_constant) uniform Target {
+  vec2 scale;
+  vec2 offset;
+};
+
+layout(location = 0) out vec2 fragUV;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+  gl_Position = vec4(inPosition * scale + offset, 0.0, 1.0);
+  fragUV = inUV;
+  fragColor = inColor;
+}
@@ -0,0 +1,23 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 inPosition;
+layout(location = 1) in vec3 inColor;
+
+struct StaticDraw {
+  mat4 transform;
+  vec4 color;
+};
+
+// Indexed by the draw's firstInstance, which gl_InstanceIndex includes.
+layout(std430, set = 0, binding = 0) readonly buffer Draws {
+  StaticDraw draws[];
+};
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+  StaticDraw d = draws[gl_InstanceIndex];
+  gl_Position = d.transform * vec4(inPosition, 0.0, 1.0);
+  fragColor = inColor * d.color.rgb;
+}
@@ -0,0 +1,323 @@
+#include "sprites.hpp"
+#include "buffer.hpp"
+#include "descriptor.hpp"
+#include "device.hpp"
+#include "image.hpp"
+#include "pipeline.hpp"
+#include "reflect.hpp"
+#include "shader.hpp"
+
+#include <cstring>
+
+MVKE::SpriteBatch::SpriteBatch(MVKE::Instance &inst, const vk::RenderPass &renderPass, uint32_t subpass, vk::SampleCountFlagBits samples, uint32_t maxQuads) : mInst(inst), mMaxQuads(maxQuads) {
+  const auto &vertReflection = mInst.mShaders->reflection("sprite.vert");
+  const auto &fragReflection = mInst.mShaders->reflection("sprite.frag");
+
+  if (vertReflection.inputs.size() != SpriteVertex::getAttributeDescriptions().size()) {
+    throw std::runtime_error("Sprite shader inputs do not match MVKE::SpriteVertex!");
+  }
+
+  mLayout = mInst.mLayouts->pipelineLayout({&vertReflection, &fragReflection});
+  mSetLayout = mInst.mLayouts->setLayouts(mLayout).at(0);
+
+  auto attributes = SpriteVertex::getAttributeDescriptions();
+
+  MVKE::PipelineDesc desc;
+  desc.vertShader = mInst.mShaders->get("sprite.vert");
+  desc.fragShader = mInst.mShaders->get("sprite.frag");
+  desc.bindings = {SpriteVertex::getBindingDescription()};
+  desc.attributes.assign(attributes.begin(), attributes.end());
+  desc.cullMode = vk::CullModeFlagBits::eNone;
+  desc.samples = samples;
+  desc.blendEnable = true;
+  desc.srcColorBlend = vk::BlendFactor::eSrcAlpha;
+  desc.dstColorBlend = vk::BlendFactor::eOneMinusSrcAlpha;
+  desc.dstAlphaBlend = vk::BlendFactor::eOneMinusSrcAlpha;
+  desc.layout = mLayout;
+  desc.renderPass = renderPass;
+  desc.subpass = subpass;
+
+  mPipelines[static_cast<size_t>(SpriteBlend::eAlpha)] = mInst.mPipelineCache->get(desc);
+
+  desc.dstColorBlend = vk::BlendFactor::eOne;
+  desc.dstAlphaBlend = vk::BlendFactor::eOne;
+
+  mPipelines[static_cast<size_t>(SpriteBlend::eAdditive)] = mInst.mPipelineCache->get(desc);
+
+  mSampler = std::make_shared<MVKE::Sampler>(mInst, vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge);
+
+  mVertices = std::make_shared<MVKE::PersistentBuffer>(mInst, MAX_CONCURRENT_FRAMES * maxQuads * 4 * sizeof (SpriteVertex), vk::BufferUsageFlagBits::eVertexBuffer);
+
+  std::vector<uint32_t> indices(maxQuads * 6);
+
+  for (uint32_t q = 0; q < maxQuads; ++q) {
+    uint32_t base = q * 4;
+    uint32_t *i = &indices[q * 6];
+
+    i[0] = base;
+    i[1] = base + 1;
+    i[2] = base + 2;
+    i[3] = base + 2;
+    i[4] = base + 1;
+    i[5] = base + 3;
+  }
+
+  mIndices = std::make_shared<MVKE::StagedBuffer>(mInst, indices.size() * sizeof indices[0], vk::BufferUsageFlagBits::eIndexBuffer);
+  memcpy(mIndices->map(0, mIndices->size()), indices.data(), mIndices->size());
+
+  mPipeline = mPipelines[static_cast<size_t>(SpriteBlend::eAlpha)];
+
+  mFrameSets.resize(MAX_CONCURRENT_FRAMES);
+
+  for (auto &f : mFrameSets) {
+    f.allocator = std::make_shared<MVKE::DescriptorAllocator>(mInst, MVKE::DescriptorPoolProfile{64, {{vk::DescriptorType::eCombinedImageSampler, 1.0f}}});
+  }
+}
+
+void MVKE::SpriteBatch::begin(size_t frame) {
+  mFrame = frame;
+  mWrite = static_cast<SpriteVertex *>(mVertices->data()) + frame * mMaxQuads * 4;
+  mQuads = 0;
+
+  // Follow pipelines swapped in by a shader reload.
+  for (auto &p : mPipelines) {
+    p = mInst.mPipelineCache->current(p);
+  }
+
+  mPipeline = mInst.mPipelineCache->current(mPipeline);
+
+  // Nothing still in flight uses this slot's sets, and the views they were
+  // keyed on may have been destroyed since.
+  mFrameSets[frame].allocator->reset();
+  mFrameSets[frame].sets.clear();
+
+  // The last frame's texture set belongs to another slot.
+  mTexture = vk::DescriptorSet();
+  mBatches.clear();
+  split();
+}
+
+void MVKE::SpriteBatch::setTexture(const MVKE::Image &texture) {
+  FrameSets &frame = mFrameSets[mFrame];
+  auto it = frame.sets.find(static_cast<VkImageView>(texture.view()));
+
+  if (it == frame.sets.end()) {
+    vk::DescriptorSet set = frame.allocator->allocate(mSetLayout);
+    vk::DescriptorImageInfo info(mSampler->sampler(), texture.view(), vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    mInst.mDevice->device().updateDescriptorSets(vk::WriteDescriptorSet(set, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &info), {});
+
+    it = frame.sets.emplace(static_cast<VkImageView>(texture.view()), set).first;
+  }
+
+  if (it->second == mTexture) return;
+
+  mTexture = it->second;
+  split();
+}
+
+void MVKE::SpriteBatch::setBlend(MVKE::SpriteBlend blend) {
+  vk::Pipeline pipeline = mPipelines[static_cast<size_t>(blend)];
+
+  if (pipeline == mPipeline) return;
+
+  mPipeline = pipeline;
+  split();
+}
+
+void MVKE::SpriteBatch::draw(glm::vec2 pos, glm::vec2 size, glm::vec4 uv, uint32_t color) {
+  if (mQuads == mMaxQuads) {
+    throw std::runtime_error("Sprite batch full!");
+  }
+
+  SpriteVertex *v = mWrite + mQuads * 4;
+
+  v[0] = {pos, {uv.x, uv.y}, color};
+  v[1] = {{pos.x + size.x, pos.y}, {uv.z, uv.y}, color};
+  v[2] = {{pos.x, pos.y + size.y}, {uv.x, uv.w}, color};
+  v[3] = {pos + size, {uv.z, uv.w}, color};
+
+  ++mQuads;
+  ++mBatches.back().quads;
+}
+
+void MVKE::SpriteBatch::end() {
+  mStats.quads = mQuads;
+  mStats.batches = 0;
+
+  for (const auto &b : mBatches) {
+    if (b.quads == 0) continue;
+
+    if (!b.texture) {
+      throw std::runtime_error("Sprites drawn without a texture!");
+    }
+
+    ++mStats.batches;
+  }
+
+  vk::DeviceSize stride = 4 * sizeof (SpriteVertex);
+  mVertices->flush(mFrame * mMaxQuads * stride, mQuads * stride);
+
+  mWrite = nullptr;
+}
+
+void MVKE::SpriteBatch::record(const vk::CommandBuffer &cmd, vk::Extent2D extent) const {
+  if (mQuads == 0) return;
+
+  const auto &dispatch = mInst.mDevice->dispatch();
+
+  vk::DeviceSize offset = mFrame * mMaxQuads * 4 * sizeof (SpriteVertex);
+  std::array<float, 4> target = {2.0f / extent.width, 2.0f / extent.height, -1.0f, -1.0f};
+
+  cmd.bindVertexBuffers(0, {mVertices->buffer()}, {offset}, dispatch);
+  cmd.bindIndexBuffer(mIndices->buffer(), 0, vk::IndexType::eUint32, dispatch);
+  cmd.pushConstants(mLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof target, target.data(), dispatch);
+
+  vk::Pipeline pipeline;
+  vk::DescriptorSet texture;
+
+  for (const auto &b : mBatches) {
+    if (b.quads == 0) continue;
+
+    if (b.pipeline != pipeline) {
+      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, b.pipeline, dispatch);
+      pipeline = b.pipeline;
+    }
+
+    if (b.texture != texture) {
+      cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mLayout, 0, b.texture, {}, dispatch);
+      texture = b.texture;
+    }
+
+    cmd.drawIndexed(b.quads * 6, 1, b.firstQuad * 6, 0, 0, dispatch);
+  }
+}
+
+// Starts a batch with the current state, reusing the last one if nothing
+// was drawn with it.
+void MVKE::SpriteBatch::split() {
+  if (!mBatches.empty() && mBatches.back().quads == 0) {
+    mBatches.back().pipeline = mPipeline;
+    mBatches.back().texture = mTexture;
+    return;
+  }
+
+  mBatches.push_back({mPipeline, mTexture, mQuads, 0});
+}
+
+uint32_t MVKE::SpriteBatch::capacity() const { return mMaxQuads; }
+const MVKE::SpriteBatch::Stats &MVKE::SpriteBatch::stats() const { return mStats; }
+
+MVKE::SpriteCanvas::SpriteCanvas(MVKE::Instance &inst, vk::Extent2D extent, uint32_t maxQuads, vk::Format format) : mInst(inst), mExtent(extent) {
+  mTarget = std::make_shared<MVKE::Image>(mInst, extent, format, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc);
+
+  vk::AttachmentDescription attachment(
+    vk::AttachmentDescriptionFlags(),
+    format,
+    vk::SampleCountFlagBits::e1,
+    vk::AttachmentLoadOp::eClear,
+    vk::AttachmentStoreOp::eStore,
+    vk::AttachmentLoadOp::eDontCare,
+    vk::AttachmentStoreOp::eDontCare,
+    vk::ImageLayout::eUndefined,
+    vk::ImageLayout::eColorAttachmentOptimal
+  );
+
+  vk::AttachmentReference colorRef(0, vk::ImageLayout::eColorAttachmentOptimal);
+
+  vk::SubpassDescription subpass(
+    vk::SubpassDescriptionFlags(),
+    vk::PipelineBindPoint::eGraphics,
+    0,
+    nullptr,
+    1,
+    &colorRef
+  );
+
+  // The previous frame's writes to the target finish before this one clears it.
+  vk::SubpassDependency dependency(
+    VK_SUBPASS_EXTERNAL,
+    0,
+    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+    vk::PipelineStageFlagBits::eColorAttachmentOutput,
+    vk::AccessFlagBits::eColorAttachmentWrite,
+    vk::AccessFlagBits::eColorAttachmentWrite
+  );
+
+  mRenderPass = mInst.mDevice->device().createRenderPassUnique({
+    vk::RenderPassCreateFlags(),
+    1,
+    &attachment,
+    1,
+    &subpass,
+    1,
+    &dependency
+  });
+
+  mFramebuffer = mInst.mDevice->device().createFramebufferUnique({
+    vk::FramebufferCreateFlags(),
+    *mRenderPass,
+    1,
+    &mTarget->view(),
+    extent.width,
+    extent.height,
+    1
+  });
+
+  QueueFamilies families = mInst.mDevice->findFamilies();
+
+  mCommandPool = mInst.mDevice->device().createCommandPoolUnique({
+    vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    *families.graphics
+  });
+
+  mCommandBuffers = mInst.mDevice->device().allocateCommandBuffersUnique({*mCommandPool, vk::CommandBufferLevel::ePrimary, MAX_CONCURRENT_FRAMES});
+
+  for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; ++i) {
+    mFences.push_back(mInst.mDevice->device().createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled)));
+  }
+
+  mBatch = std::make_shared<MVKE::SpriteBatch>(mInst, *mRenderPass, 0, vk::SampleCountFlagBits::e1, maxQuads);
+}
+
+MVKE::SpriteCanvas::~SpriteCanvas() {
+  finish();
+  mInst.mPipelineCache->evict(*mRenderPass);
+}
+
+MVKE::SpriteBatch &MVKE::SpriteCanvas::begin() {
+  mInst.mDevice->device().waitForFences(*mFences[mFrame], VK_TRUE, std::numeric_limits<uint64_t>::max(), mInst.mDevice->dispatch());
+
+  mBatch->begin(mFrame);
+  return *mBatch;
+}
+
+void MVKE::SpriteCanvas::submit() {
+  mBatch->end();
+
+  const auto &dispatch = mInst.mDevice->dispatch();
+  const vk::CommandBuffer &cmd = *mCommandBuffers[mFrame];
+
+  vk::ClearValue clear = vk::ClearColorValue(std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f});
+
+  cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}, dispatch);
+  cmd.beginRenderPass({*mRenderPass, *mFramebuffer, vk::Rect2D({0, 0}, mExtent), 1, &clear}, vk::SubpassContents::eInline, dispatch);
+  cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, mExtent.width, mExtent.height, 0.0f, 1.0f), dispatch);
+  cmd.setScissor(0, vk::Rect2D({0, 0}, mExtent), dispatch);
+  mBatch->record(cmd, mExtent);
+  cmd.endRenderPass(dispatch);
+  cmd.end(dispatch);
+
+  mInst.mDevice->device().resetFences(*mFences[mFrame], dispatch);
+  mInst.mQueues.graphics.submit({{0, nullptr, nullptr, 1, &cmd, 0, nullptr}}, *mFences[mFrame], dispatch);
+
+  mFrame = (mFrame + 1) % MAX_CONCURRENT_FRAMES;
+}
+
+void MVKE::SpriteCanvas::finish() {
+  for (const auto &f : mFences) {
+    mInst.mDevice->device().waitForFences(*f, VK_TRUE, std::numeric_limits<uint64_t>::max(), mInst.mDevice->dispatch());
+  }
+}
+
+const MVKE::Image &MVKE::SpriteCanvas::target() const { return *mTarget; }
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  enum class SpriteBlend {
+    eAlpha,
+    eAdditive,
+  };
+
+  // Streams 2D quads in pixel coordinates. Each frame in flight writes its
+  // vertices straight into its own region of one persistently mapped
+  // buffer, and all quads share a static index buffer. Quads are drawn in
+  // submission order, with a new batch only where the texture or blend mode
+  // changes.
+  //
+  // Texture sets are allocated per frame slot and dropped when the slot is
+  // begun again, so a view handle reused by a later image never finds a set
+  // that still points at the old one.
+  class SpriteBatch {
+  public:
+    struct Stats {
+      uint32_t quads = 0;
+      uint32_t batches = 0;
+    };
+
+    SpriteBatch(MVKE::Instance &inst, const vk::RenderPass &renderPass, uint32_t subpass, vk::SampleCountFlagBits samples, uint32_t maxQuads);
+
+    // The slot's previous frame must have finished on the GPU. The blend
+    // mode carries over from the last frame, but the texture must be set
+    // again.
+    void begin(size_t frame);
+    // The texture must stay alive until the frame has finished on the GPU.
+    void setTexture(const MVKE::Image &texture);
+    void setBlend(MVKE::SpriteBlend blend);
+    // uv is (u0, v0, u1, v1); color is RGBA8 with red in the low byte.
+    void draw(glm::vec2 pos, glm::vec2 size, glm::vec4 uv = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f), uint32_t color = 0xffffffff);
+    void end();
+
+    // Inside the render pass given at construction, drawing into extent.
+    void record(const vk::CommandBuffer &cmd, vk::Extent2D extent) const;
+
+    uint32_t capacity() const;
+    const Stats &stats() const;
+  private:
+    struct Batch {
+      vk::Pipeline pipeline;
+      vk::DescriptorSet texture;
+      uint32_t firstQuad;
+      uint32_t quads;
+    };
+
+    struct FrameSets {
+      std::shared_ptr<MVKE::DescriptorAllocator> allocator;
+      std::unordered_map<VkImageView, vk::DescriptorSet> sets;
+    };
+
+    void split();
+
+    MVKE::Instance &mInst;
+
+    uint32_t mMaxQuads;
+
+    vk::PipelineLayout mLayout;
+    vk::DescriptorSetLayout mSetLayout;
+    std::array<vk::Pipeline, 2> mPipelines;
+    std::shared_ptr<MVKE::Sampler> mSampler;
+    std::vector<FrameSets> mFrameSets;
+
+    std::shared_ptr<MVKE::PersistentBuffer> mVertices;
+    std::shared_ptr<MVKE::Buffer> mIndices;
+
+    size_t mFrame = 0;
+    MVKE::SpriteVertex *mWrite = nullptr;
+    uint32_t mQuads = 0;
+    vk::Pipeline mPipeline;
+    vk::DescriptorSet mTexture;
+    std::vector<Batch> mBatches;
+
+    Stats mStats;
+  };
+
+  // An offscreen colour target with its own render pass, command buffers
+  // and fences, so sprites can be drawn without a window, e.g. by a
+  // headless instance.
+  class SpriteCanvas {
+  public:
+    SpriteCanvas(MVKE::Instance &inst, vk::Extent2D extent, uint32_t maxQuads, vk::Format format = vk::Format::eR8G8B8A8Unorm);
+    ~SpriteCanvas();
+
+    // Waits for the next frame slot and returns the batch begun on it.
+    MVKE::SpriteBatch &begin();
+    // Ends the batch, records the frame and submits it.
+    void submit();
+    // Waits for every submitted frame.
+    void finish();
+
+    const MVKE::Image &target() const;
+  private:
+    MVKE::Instance &mInst;
+
+    vk::Extent2D mExtent;
+
+    std::shared_ptr<MVKE::Image> mTarget;
+    vk::UniqueRenderPass mRenderPass;
+    vk::UniqueFramebuffer mFramebuffer;
+
+    vk::UniqueCommandPool mCommandPool;
+    std::vector<vk::UniqueCommandBuffer> mCommandBuffers;
+    std::vector<vk::UniqueFence> mFences;
+
+    std::shared_ptr<MVKE::SpriteBatch> mBatch;
+
+    size_t mFrame = 0;
+  };
+}
@@ -0,0 +1,118 @@
+#include "staticbatch.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+#include "reflect.hpp"
+#include "shader.hpp"
+
+#include <cstring>
+
+std::vector<MVKE::DeviceFeature> MVKE::StaticBatch::deviceFeatures() {
+  return {
+    MVKE::DeviceFeature::core("multi-draw indirect", &vk::PhysicalDeviceFeatures::multiDrawIndirect, &MVKE::Capabilities::multiDrawIndirect),
+    MVKE::DeviceFeature::core("indirect first instance", &vk::PhysicalDeviceFeatures::drawIndirectFirstInstance, &MVKE::Capabilities::drawIndirectFirstInstance),
+  };
+}
+
+MVKE::StaticBatch::StaticBatch(MVKE::Instance &inst) : mInst(inst) {
+  // The same cached layout the static pipeline was built with.
+  mLayout = mInst.mLayouts->pipelineLayout({&mInst.mShaders->reflection("static.vert"), &mInst.mShaders->reflection("shader.frag")});
+
+  // One set for the life of the batch, rewritten by each commit(). A cached
+  // set would be keyed on the draw buffer's handle, which a later buffer
+  // may reuse.
+  vk::DescriptorPoolSize size(vk::DescriptorType::eStorageBuffer, 1);
+  mPool = mInst.mDevice->device().createDescriptorPoolUnique({vk::DescriptorPoolCreateFlags(), 1, 1, &size});
+
+  vk::DescriptorSetLayout setLayout = mInst.mLayouts->setLayouts(mLayout).at(0);
+  mSet = mInst.mDevice->device().allocateDescriptorSets({*mPool, 1, &setLayout}).at(0);
+}
+
+MVKE::StaticBatch::MeshId MVKE::StaticBatch::addMesh(const std::vector<MVKE::Vertex> &vertices, const std::vector<uint32_t> &indices) {
+  mMeshes.push_back({static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(mIndices.size()), static_cast<int32_t>(mVertices.size())});
+
+  mVertices.insert(mVertices.end(), vertices.begin(), vertices.end());
+  mIndices.insert(mIndices.end(), indices.begin(), indices.end());
+
+  mDirty = true;
+
+  return mMeshes.size() - 1;
+}
+
+MVKE::StaticBatch::DrawId MVKE::StaticBatch::add(MeshId mesh, const MVKE::StaticDrawData &data) {
+  const Mesh &m = mMeshes.at(mesh);
+  DrawId id = mDraws.size();
+
+  mCommands.push_back(vk::DrawIndexedIndirectCommand(m.indexCount, 1, m.firstIndex, m.vertexOffset, id));
+  mDraws.push_back(data);
+
+  mDirty = true;
+
+  return id;
+}
+
+void MVKE::StaticBatch::update(DrawId draw, const MVKE::StaticDrawData &data) {
+  mDraws.at(draw) = data;
+  mDirty = true;
+}
+
+void MVKE::StaticBatch::clear() {
+  mVertices.clear();
+  mIndices.clear();
+  mMeshes.clear();
+  mCommands.clear();
+  mDraws.clear();
+
+  mDirty = true;
+}
+
+void MVKE::StaticBatch::commit() {
+  mDirty = false;
+  mCommitted = mCommands;
+
+  if (mCommands.empty()) {
+    mVertexBuffer.reset();
+    mIndexBuffer.reset();
+    mIndirectBuffer.reset();
+    mDrawBuffer.reset();
+    return;
+  }
+
+  auto upload = [this](const void *data, uint64_t size, vk::BufferUsageFlags usage) {
+    auto buf = std::make_shared<MVKE::StagedBuffer>(mInst, size, usage);
+    memcpy(buf->map(0, size), data, size);
+    return buf;
+  };
+
+  mVertexBuffer = upload(mVertices.data(), mVertices.size() * sizeof mVertices[0], vk::BufferUsageFlagBits::eVertexBuffer);
+  mIndexBuffer = upload(mIndices.data(), mIndices.size() * sizeof mIndices[0], vk::BufferUsageFlagBits::eIndexBuffer);
+  mIndirectBuffer = upload(mCommands.data(), mCommands.size() * sizeof mCommands[0], vk::BufferUsageFlagBits::eIndirectBuffer);
+  mDrawBuffer = upload(mDraws.data(), mDraws.size() * sizeof mDraws[0], vk::BufferUsageFlagBits::eStorageBuffer);
+
+  vk::DescriptorBufferInfo drawInfo(mDrawBuffer->buffer(), 0, VK_WHOLE_SIZE);
+  mInst.mDevice->device().updateDescriptorSets(vk::WriteDescriptorSet(mSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &drawInfo), {});
+}
+
+void MVKE::StaticBatch::record(const vk::CommandBuffer &cmd) const {
+  if (mCommitted.empty()) return;
+
+  const auto &dispatch = mInst.mDevice->dispatch();
+
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, mLayout, 0, mSet, {}, dispatch);
+  cmd.bindVertexBuffers(0, {mVertexBuffer->buffer()}, {0}, dispatch);
+  cmd.bindIndexBuffer(mIndexBuffer->buffer(), 0, vk::IndexType::eUint32, dispatch);
+
+  // A non-zero firstInstance in an indirect command needs its own feature;
+  // without it, or without multi-draw, the same draws go direct.
+  const auto &caps = mInst.mDevice->capabilities();
+
+  if (caps.multiDrawIndirect && caps.drawIndirectFirstInstance) {
+    cmd.drawIndexedIndirect(mIndirectBuffer->buffer(), 0, mCommitted.size(), sizeof mCommitted[0], dispatch);
+  } else {
+    for (const auto &c : mCommitted) {
+      cmd.drawIndexed(c.indexCount, c.instanceCount, c.firstIndex, c.vertexOffset, c.firstInstance, dispatch);
+    }
+  }
+}
+
+bool MVKE::StaticBatch::dirty() const { return mDirty; }
+size_t MVKE::StaticBatch::size() const { return mCommands.size(); }
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.hpp>
+#include <memory>
+#include <vector>
+
+#include "mvke.hpp"
+
+namespace MVKE {
+  // Matches StaticDraw in shaders/static.vert.
+  struct StaticDrawData {
+    glm::mat4 transform;
+    glm::vec4 color;
+  };
+
+  // Static meshes merged into one vertex and one index buffer and drawn
+  // with a single multi-draw indirect call. Each draw's firstInstance is its
+  // index into a storage buffer of StaticDrawData, which static.vert reads
+  // through gl_InstanceIndex.
+  //
+  // The GPU buffers are only rebuilt by commit(), after the set changes.
+  class StaticBatch {
+  public:
+    using MeshId = uint32_t;
+    using DrawId = uint32_t;
+
+    StaticBatch(MVKE::Instance &inst);
+
+    // Multi-draw indirect with a non-zero firstInstance; without both the
+    // draws are issued one by one.
+    static std::vector<MVKE::DeviceFeature> deviceFeatures();
+
+    MeshId addMesh(const std::vector<MVKE::Vertex> &vertices, const std::vector<uint32_t> &indices);
+    DrawId add(MeshId mesh, const MVKE::StaticDrawData &data);
+    void update(DrawId draw, const MVKE::StaticDrawData &data);
+    void clear();
+
+    bool dirty() const;
+    // Uploads the merged buffers; the GPU must be done with the old ones.
+    void commit();
+
+    // Expects a pipeline built from static.vert to be bound.
+    void record(const vk::CommandBuffer &cmd) const;
+
+    size_t size() const;
+  private:
+    struct Mesh {
+      uint32_t indexCount;
+      uint32_t firstIndex;
+      int32_t vertexOffset;
+    };
+
+    MVKE::Instance &mInst;
+
+    vk::PipelineLayout mLayout;
+
+    std::vector<MVKE::Vertex> mVertices;
+    std::vector<uint32_t> mIndices;
+    std::vector<Mesh> mMeshes;
+    std::vector<vk::DrawIndexedIndirectCommand> mCommands;
+    std::vector<MVKE::StaticDrawData> mDraws;
+
+    std::shared_ptr<MVKE::Buffer> mVertexBuffer;
+    std::shared_ptr<MVKE::Buffer> mIndexBuffer;
+    std::shared_ptr<MVKE::Buffer> mIndirectBuffer;
+    std::shared_ptr<MVKE::Buffer> mDrawBuffer;
+    vk::UniqueDescriptorPool mPool;
+    vk::DescriptorSet mSet;
+
+    // The draws the GPU buffers hold, for the direct fallback.
+    std::vector<vk::DrawIndexedIndirectCommand> mCommitted;
+    bool mDirty = false;
+  };
+}
@@ -0,0 +1,367 @@
+#include "streamer.hpp"
+#include "buffer.hpp"
+#include "device.hpp"
+#include "image.hpp"
+
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+static void skipPPMSpace(std::istream &in) {
+  while (in) {
+    int c = in.peek();
+
+    if (c == '#') {
+      std::string comment;
+      std::getline(in, comment);
+    } else if (std::isspace(c)) {
+      in.get();
+    } else {
+      break;
+    }
+  }
+}
+
+MVKE::DecodedImage MVKE::decodePPM(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open file!");
+  }
+
+  std::string magic;
+  unsigned width, height, maxVal;
+
+  file >> magic;
+  skipPPMSpace(file);
+  file >> width;
+  skipPPMSpace(file);
+  file >> height;
+  skipPPMSpace(file);
+  file >> maxVal;
+  file.get();
+
+  if (!file || magic != "P6" || maxVal > 255) {
+    throw std::runtime_error("Unsupported PPM file!");
+  }
+
+  // No device takes a larger 2D image; the streamer checks the actual limit.
+  if (width == 0 || height == 0 || width > 32768 || height > 32768) {
+    throw std::runtime_error("Unsupported PPM dimensions!");
+  }
+
+  size_t texels = static_cast<size_t>(width) * height;
+
+  if (texels > std::numeric_limits<size_t>::max() / 4) {
+    throw std::runtime_error("PPM file too large!");
+  }
+
+  std::vector<uint8_t> rgb(texels * 3);
+  file.read(reinterpret_cast<char *>(rgb.data()), rgb.size());
+
+  if (!file) {
+    throw std::runtime_error("Truncated PPM file!");
+  }
+
+  MVKE::DecodedImage img{{width, height}, vk::Format::eR8G8B8A8Unorm, std::vector<uint8_t>(texels * 4)};
+
+  for (size_t i = 0; i < texels; ++i) {
+    img.pixels[i * 4 + 0] = rgb[i * 3 + 0];
+    img.pixels[i * 4 + 1] = rgb[i * 3 + 1];
+    img.pixels[i * 4 + 2] = rgb[i * 3 + 2];
+    img.pixels[i * 4 + 3] = 255;
+  }
+
+  return img;
+}
+
+const std::string &MVKE::Streamer::Asset::path() const { return mPath; }
+MVKE::Streamer::State MVKE::Streamer::Asset::state() const { return mState; }
+const MVKE::Texture *MVKE::Streamer::Asset::texture() const { return mTexture.get(); }
+MVKE::BindlessTable::Handle MVKE::Streamer::Asset::index() const { return mIndex; }
+
+MVKE::Streamer::Streamer(MVKE::Instance &inst, uint64_t memoryBudget, uint64_t uploadBudget, double uploadMillis, unsigned threads, MVKE::Decoder decoder)
+: mInst(inst), mDecoder(decoder), mMemoryBudget(memoryBudget), mUploadBudget(uploadBudget), mUploadMillis(uploadMillis) {
+  QueueFamilies families = mInst.mDevice->findFamilies();
+
+  mCommandPool = mInst.mDevice->device().createCommandPoolUnique({
+    vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    *families.graphics
+  });
+
+  auto cmds = mInst.mDevice->device().allocateCommandBuffersUnique({*mCommandPool, vk::CommandBufferLevel::ePrimary, MAX_CONCURRENT_FRAMES});
+
+  mUploads.resize(MAX_CONCURRENT_FRAMES);
+
+  for (size_t i = 0; i < MAX_CONCURRENT_FRAMES; ++i) {
+    mUploads[i].cmd = std::move(cmds[i]);
+    mUploads[i].fence = mInst.mDevice->device().createFenceUnique(vk::FenceCreateInfo());
+    mUploads[i].staging = std::make_shared<MVKE::MappableBuffer>(mInst, mUploadBudget, vk::BufferUsageFlagBits::eTransferSrc);
+  }
+
+  mSampler = std::make_shared<MVKE::Sampler>(mInst);
+
+  for (unsigned i = 0; i < threads; ++i) {
+    mThreads.emplace_back(&MVKE::Streamer::decodeLoop, this);
+  }
+}
+
+MVKE::Streamer::~Streamer() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mStopping = true;
+  }
+
+  mCond.notify_all();
+
+  for (auto &t : mThreads) {
+    t.join();
+  }
+
+  for (auto &up : mUploads) {
+    if (up.submitted) {
+      mInst.mDevice->device().waitForFences(*up.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    }
+  }
+}
+
+void MVKE::Streamer::decodeLoop() {
+  while (true) {
+    std::shared_ptr<Asset> asset;
+
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mCond.wait(lock, [this] { return mStopping || !mDecodeQueue.empty(); });
+
+      if (mStopping) return;
+
+      asset = mDecodeQueue.front();
+      mDecodeQueue.pop_front();
+    }
+
+    try {
+      asset->mDecoded = std::make_unique<MVKE::DecodedImage>(mDecoder(asset->mPath));
+
+      const vk::Extent2D &extent = asset->mDecoded->extent;
+      uint32_t maxDimension = mInst.mDevice->properties().limits.maxImageDimension2D;
+
+      if (extent.width == 0 || extent.height == 0 || extent.width > maxDimension || extent.height > maxDimension) {
+        throw std::runtime_error("Image dimensions out of range!");
+      }
+    } catch (std::exception &e) {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mFailedQueue.push_back({asset, e.what()});
+      continue;
+    }
+
+    asset->mState = State::eDecoded;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mUploadQueue.push_back(asset);
+  }
+}
+
+std::shared_ptr<MVKE::Streamer::Asset> MVKE::Streamer::request(const std::string &path, std::function<void(const Asset &)> onResident) {
+  auto it = mAssets.find(path);
+
+  std::shared_ptr<Asset> asset;
+
+  if (it != mAssets.end()) {
+    asset = it->second;
+
+    if (asset->mState == State::eResident) {
+      touch(*asset);
+      if (onResident) onResident(*asset);
+      return asset;
+    }
+
+    if (onResident) asset->mOnResident.push_back(onResident);
+
+    if (asset->mState != State::eEvicted) return asset;
+  } else {
+    asset = std::make_shared<Asset>();
+    asset->mPath = path;
+    if (onResident) asset->mOnResident.push_back(onResident);
+    mAssets.emplace(path, asset);
+  }
+
+  asset->mState = State::eQueued;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDecodeQueue.push_back(asset);
+  }
+
+  mCond.notify_one();
+
+  return asset;
+}
+
+void MVKE::Streamer::touch(MVKE::Streamer::Asset &asset) {
+  asset.mLastUsed = mFrameCount;
+
+  if (asset.mState == State::eResident) {
+    mLru.splice(mLru.begin(), mLru, asset.mLru);
+  }
+}
+
+void MVKE::Streamer::update(size_t frame) {
+  ++mFrameCount;
+
+  std::deque<std::pair<std::shared_ptr<Asset>, std::string>> failed;
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    failed.swap(mFailedQueue);
+  }
+
+  for (auto &f : failed) {
+    std::cerr << "Failed to stream " << f.first->mPath << ": " << f.second << std::endl;
+
+    f.first->mState = State::eFailed;
+    f.first->mOnResident.clear();
+    mAssets.erase(f.first->mPath);
+    ++mStats.failures;
+  }
+
+  Upload &up = mUploads[frame];
+
+  if (up.submitted) {
+    // Uploads never stall the frame: if the copy from this slot's last turn
+    // has not finished, we simply start nothing new this frame.
+    if (mInst.mDevice->device().getFenceStatus(*up.fence, mInst.mDevice->dispatch()) != vk::Result::eSuccess) return;
+    retire(up);
+  }
+
+  evict();
+
+  auto start = std::chrono::steady_clock::now();
+  uint64_t offset = 0;
+
+  while (true) {
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    if (offset >= mUploadBudget || elapsed.count() >= mUploadMillis) break;
+
+    std::shared_ptr<Asset> asset;
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (mUploadQueue.empty()) break;
+
+      uint64_t size = mUploadQueue.front()->mDecoded->pixels.size();
+
+      // Oversized assets go alone through a dedicated staging buffer.
+      if (offset > 0 && offset + size > mUploadBudget) break;
+
+      // Past the memory budget, make room from the cold end of the LRU.
+      // Wait only while what is left may still be in flight, unless
+      // nothing is loaded at all and the asset could never fit.
+      evict(size);
+
+      uint64_t used = mStats.residentBytes + mStats.uploadingBytes;
+      if (used > 0 && used + size > mMemoryBudget) break;
+
+      asset = mUploadQueue.front();
+      mUploadQueue.pop_front();
+    }
+
+    if (up.assets.empty()) {
+      up.cmd->begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}, mInst.mDevice->dispatch());
+    }
+
+    const auto &decoded = *asset->mDecoded;
+    uint64_t size = decoded.pixels.size();
+
+    MVKE::MappableBuffer *staging = up.staging.get();
+    uint64_t stagingOffset = offset;
+
+    if (size > mUploadBudget) {
+      up.oversized.push_back(std::make_shared<MVKE::MappableBuffer>(mInst, size, vk::BufferUsageFlagBits::eTransferSrc));
+      staging = up.oversized.back().get();
+      stagingOffset = 0;
+    }
+
+    memcpy(staging->map(stagingOffset, size), decoded.pixels.data(), size);
+
+    asset->mTexture = std::make_shared<MVKE::Texture>(mInst, decoded.extent, decoded.format);
+    asset->mTexture->recordUpload(*up.cmd, staging->buffer(), stagingOffset);
+    asset->mDecoded.reset();
+    asset->mState = State::eUploading;
+
+    mStats.uploadingBytes += asset->mTexture->size();
+
+    up.assets.push_back(asset);
+
+    // Keep copy offsets aligned for any texel size we may stage.
+    offset += (size + 15) & ~uint64_t(15);
+
+    mStats.uploadedBytes += size;
+    ++mStats.uploads;
+  }
+
+  if (up.assets.empty()) return;
+
+  up.cmd->end(mInst.mDevice->dispatch());
+
+  mInst.mQueues.graphics.submit({{0, nullptr, nullptr, 1, &up.cmd.get(), 0, nullptr}}, *up.fence, mInst.mDevice->dispatch());
+  up.submitted = true;
+}
+
+void MVKE::Streamer::retire(MVKE::Streamer::Upload &up) {
+  mInst.mDevice->device().resetFences(*up.fence, mInst.mDevice->dispatch());
+
+  for (auto &asset : up.assets) {
+    asset->mState = State::eResident;
+    asset->mLastUsed = mFrameCount;
+    asset->mIndex = mInst.mBindless->addImage({
+      mSampler->sampler(),
+      asset->mTexture->view(),
+      vk::ImageLayout::eShaderReadOnlyOptimal
+    });
+
+    mLru.push_front(asset.get());
+    asset->mLru = mLru.begin();
+
+    mStats.uploadingBytes -= asset->mTexture->size();
+    mStats.residentBytes += asset->mTexture->size();
+
+    for (auto &cb : asset->mOnResident) {
+      cb(*asset);
+    }
+
+    asset->mOnResident.clear();
+  }
+
+  up.assets.clear();
+  up.oversized.clear();
+  up.submitted = false;
+}
+
+void MVKE::Streamer::evict(uint64_t headroom) {
+  while (mStats.residentBytes + mStats.uploadingBytes + headroom > mMemoryBudget && !mLru.empty()) {
+    Asset *asset = mLru.back();
+
+    // Anything touched by a frame that may still be in flight stays; the
+    // list is ordered, so nothing further forward can go either.
+    if (mFrameCount - asset->mLastUsed <= MAX_CONCURRENT_FRAMES) break;
+
+    mInst.mBindless->remove(MVKE::BindlessTable::eImage, asset->mIndex);
+    asset->mIndex = MVKE::BindlessTable::sInvalid;
+
+    mStats.residentBytes -= asset->mTexture->size();
+    asset->mTexture.reset();
+    asset->mState = State::eEvicted;
+
+    mLru.pop_back();
+    ++mStats.evictions;
+  }
+}
+
+void MVKE::Streamer::setMemoryBudget(uint64_t bytes) {
+  mMemoryBudget = bytes;
+}
+
+const MVKE::Streamer::Stats &MVKE::Streamer::stats() const { return mStats; }
\ No newline at end of file
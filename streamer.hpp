@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "mvke.hpp"
+#include "bindless.hpp"
+
+namespace MVKE {
+  struct DecodedImage {
+    vk::Extent2D extent;
+    vk::Format format;
+    std::vector<uint8_t> pixels;
+  };
+
+  using Decoder = std::function<MVKE::DecodedImage(const std::string &path)>;
+
+  // Binary PPM (P6) to RGBA8, enough to stream assets without an image library.
+  MVKE::DecodedImage decodePPM(const std::string &path);
+
+  class Streamer {
+  public:
+    enum class State {
+      eQueued,
+      eDecoded,
+      eUploading,
+      eResident,
+      eEvicted,
+      eFailed,
+    };
+
+    class Asset {
+      friend Streamer;
+    public:
+      const std::string &path() const;
+      State state() const;
+      const MVKE::Texture *texture() const;
+      // sInvalid until resident, or when the bindless table is disabled.
+      MVKE::BindlessTable::Handle index() const;
+    private:
+      std::string mPath;
+      std::atomic<State> mState{State::eQueued};
+      std::unique_ptr<MVKE::DecodedImage> mDecoded;
+      std::shared_ptr<MVKE::Texture> mTexture;
+      MVKE::BindlessTable::Handle mIndex = MVKE::BindlessTable::sInvalid;
+      uint64_t mLastUsed = 0;
+      std::list<Asset *>::iterator mLru;
+      std::vector<std::function<void(const Asset &)>> mOnResident;
+    };
+
+    struct Stats {
+      uint64_t residentBytes = 0;
+      // Textures created but still being copied; they count against the
+      // memory budget like resident ones.
+      uint64_t uploadingBytes = 0;
+      uint64_t uploadedBytes = 0;
+      uint64_t uploads = 0;
+      uint64_t evictions = 0;
+      uint64_t failures = 0;
+    };
+
+    Streamer(MVKE::Instance &inst, uint64_t memoryBudget, uint64_t uploadBudget, double uploadMillis = 2.0, unsigned threads = 2, MVKE::Decoder decoder = MVKE::decodePPM);
+    ~Streamer();
+
+    // If the asset fails to load, the failure is logged, onResident is
+    // dropped and the asset forgotten, so a later request tries again.
+    std::shared_ptr<Asset> request(const std::string &path, std::function<void(const Asset &)> onResident = nullptr);
+    void touch(Asset &asset);
+    void update(size_t frame);
+
+    void setMemoryBudget(uint64_t bytes);
+    const Stats &stats() const;
+  private:
+    struct Upload {
+      vk::UniqueCommandBuffer cmd;
+      vk::UniqueFence fence;
+      std::shared_ptr<MVKE::MappableBuffer> staging;
+      std::vector<std::shared_ptr<MVKE::MappableBuffer>> oversized;
+      std::vector<std::shared_ptr<Asset>> assets;
+      bool submitted = false;
+    };
+
+    void decodeLoop();
+    void retire(Upload &upload);
+    // Evicts least recently used assets until headroom more bytes fit in
+    // the memory budget, or the rest may still be in use by the GPU.
+    void evict(uint64_t headroom = 0);
+
+    MVKE::Instance &mInst;
+    MVKE::Decoder mDecoder;
+
+    uint64_t mMemoryBudget;
+    uint64_t mUploadBudget;
+    double mUploadMillis;
+    uint64_t mFrameCount = 0;
+
+    std::unordered_map<std::string, std::shared_ptr<Asset>> mAssets;
+    std::list<Asset *> mLru;
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    std::deque<std::shared_ptr<Asset>> mDecodeQueue;
+    std::deque<std::shared_ptr<Asset>> mUploadQueue;
+    // Decode failures and their reasons, handled on the main thread.
+    std::deque<std::pair<std::shared_ptr<Asset>, std::string>> mFailedQueue;
+    bool mStopping = false;
+    std::vector<std::thread> mThreads;
+
+    vk::UniqueCommandPool mCommandPool;
+    std::vector<Upload> mUploads;
+    std::shared_ptr<MVKE::Sampler> mSampler;
+
+    Stats mStats;
+  };
+}
\ No newline at end of file
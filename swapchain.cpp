@@ -2,6 +2,10 @@
 #include "pipeline.hpp"
 #include "mvke.hpp"
 #include "device.hpp"
+#include "image.hpp"
+
+#include <array>
+#include <iostream>
 
 bool MVKE::Swapchain::adequate(const vk::PhysicalDevice &dev, MVKE::Instance &inst) {
   auto details = querySupport(dev, inst);
@@ -9,6 +13,10 @@ bool MVKE::Swapchain::adequate(const vk::PhysicalDevice &dev, MVKE::Instance &in
   return !details.formats.empty() && !details.presentModes.empty();
 }
 
+std::vector<MVKE::DeviceFeature> MVKE::Swapchain::deviceFeatures() {
+  return {MVKE::DeviceFeature::extension("swapchain", VK_KHR_SWAPCHAIN_EXTENSION_NAME, nullptr, true)};
+}
+
 MVKE::SwapchainSupportDetails MVKE::Swapchain::querySupport(const vk::PhysicalDevice &dev, MVKE::Instance &inst) {
   MVKE::SwapchainSupportDetails details;
   
@@ -20,7 +28,7 @@ MVKE::SwapchainSupportDetails MVKE::Swapchain::querySupport(const vk::PhysicalDe
 }
 
 MVKE::Swapchain::Swapchain(MVKE::Instance &inst) : mInst(inst) {
-  SwapchainSupportDetails details = querySupport(mInst.mDevice->physDevice(), mInst);
+  const SwapchainSupportDetails &details = mInst.mDevice->surfaceSupport();
 
   mSurfaceFormat = chooseSurfaceFormat(details.formats);
   mPresentMode = choosePresentMode(details.presentModes);
@@ -63,9 +71,19 @@ MVKE::Swapchain::Swapchain(MVKE::Instance &inst) : mInst(inst) {
   mSwapchain = mInst.mDevice->device().createSwapchainKHRUnique(createInfo);
 
   initImages();
+
+  // Frames share the graphics queue and the graph orders each frame's
+  // writes after the last, so one set of attachments serves every swapchain
+  // image. Neither is stored: depth is discarded and MSAA colour is
+  // resolved into the swapchain image within the pass.
+  mDepth = std::make_shared<MVKE::TransientAttachment>(mInst, mExtent, mInst.mDevice->depthFormat(), vk::ImageUsageFlagBits::eDepthStencilAttachment, mInst.mSamples);
+
+  if (mInst.mSamples != vk::SampleCountFlagBits::e1) {
+    mColor = std::make_shared<MVKE::TransientAttachment>(mInst, mExtent, mSurfaceFormat.format, vk::ImageUsageFlagBits::eColorAttachment, mInst.mSamples);
+  }
 }
 
-vk::SurfaceFormatKHR MVKE::Swapchain::chooseSurfaceFormat(std::vector<vk::SurfaceFormatKHR> &available) {
+vk::SurfaceFormatKHR MVKE::Swapchain::chooseSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &available) {
   if (available.size() == 1 && available[0].format == vk::Format::eUndefined) {
     return {vk::Format::eB8G8R8A8Unorm, vk::ColorSpaceKHR::eSrgbNonlinear};
   }
@@ -79,7 +97,7 @@ vk::SurfaceFormatKHR MVKE::Swapchain::chooseSurfaceFormat(std::vector<vk::Surfac
   return available[0];
 }
 
-vk::PresentModeKHR MVKE::Swapchain::choosePresentMode(std::vector<vk::PresentModeKHR> &available) {
+vk::PresentModeKHR MVKE::Swapchain::choosePresentMode(const std::vector<vk::PresentModeKHR> &available) {
   vk::PresentModeKHR best = vk::PresentModeKHR::eFifo;
 
   for (const auto &mode : available) {
@@ -93,7 +111,7 @@ vk::PresentModeKHR MVKE::Swapchain::choosePresentMode(std::vector<vk::PresentMod
   return best;
 }
 
-vk::Extent2D MVKE::Swapchain::chooseExtent(vk::SurfaceCapabilitiesKHR &capabilities) {
+vk::Extent2D MVKE::Swapchain::chooseExtent(const vk::SurfaceCapabilitiesKHR &capabilities) {
   if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
     return capabilities.currentExtent;
   }
@@ -128,15 +146,70 @@ void MVKE::Swapchain::initImages() {
   }
 }
 
+// Logs the memory our attachments would take at each supported sample
+// count: depth alone when single-sampled, plus the multisampled colour
+// target otherwise. Lazily allocated memory may never be backed on tilers.
+void MVKE::Swapchain::reportSampleCosts() const {
+  const vk::Device &dev = mInst.mDevice->device();
+  vk::SampleCountFlags counts = mInst.mDevice->attachmentSampleCounts();
+
+  for (unsigned s = 1; s <= 64; s <<= 1) {
+    auto samples = static_cast<vk::SampleCountFlagBits>(s);
+    if (!(counts & samples)) continue;
+
+    uint64_t bytes = 0;
+
+    auto cost = [&](vk::Format format, vk::ImageUsageFlags usage) {
+      vk::ImageCreateInfo imageInfo(
+        vk::ImageCreateFlags(),
+        vk::ImageType::e2D,
+        format,
+        vk::Extent3D(mExtent.width, mExtent.height, 1),
+        1,
+        1,
+        samples,
+        vk::ImageTiling::eOptimal,
+        usage | vk::ImageUsageFlagBits::eTransientAttachment
+      );
+
+      auto image = dev.createImageUnique(imageInfo);
+      bytes += dev.getImageMemoryRequirements(*image).size;
+    };
+
+    cost(mInst.mDevice->depthFormat(), vk::ImageUsageFlagBits::eDepthStencilAttachment);
+
+    if (s > 1) {
+      cost(mSurfaceFormat.format, vk::ImageUsageFlagBits::eColorAttachment);
+    }
+
+    std::cout << "MSAA " << s << "x: " << (bytes >> 10) << "KiB of attachments";
+
+    if (samples == mInst.mSamples) {
+      std::cout << " (selected, " << (mDepth->lazilyAllocated() ? "lazily allocated" : "fully backed") << ")";
+    }
+
+    std::cout << std::endl;
+  }
+}
+
 void MVKE::Swapchain::initFramebuffers() {
   mFramebuffers.reserve(mImageViews.size());
 
   for (auto &view : mImageViews) {
+    std::vector<vk::ImageView> attachments;
+
+    // Matches the attachment order of Pipeline::initRenderPass.
+    if (mColor) {
+      attachments = {mColor->view(), mDepth->view(), *view};
+    } else {
+      attachments = {*view, mDepth->view()};
+    }
+
     vk::FramebufferCreateInfo framebufferInfo(
       vk::FramebufferCreateFlags(),
       mInst.mPipeline->renderPass(),
-      1,
-      &view.get(),
+      attachments.size(),
+      attachments.data(),
       mExtent.width,
       mExtent.height,
       1
@@ -149,4 +222,7 @@ void MVKE::Swapchain::initFramebuffers() {
 const vk::SwapchainKHR &MVKE::Swapchain::swapchain() const { return *mSwapchain; }
 const vk::Extent2D &MVKE::Swapchain::extent() const { return mExtent; }
 const vk::SurfaceFormatKHR &MVKE::Swapchain::surfaceFormat() const { return mSurfaceFormat; }
+const std::vector<vk::Image> &MVKE::Swapchain::images() const { return mImages; }
+const MVKE::Image &MVKE::Swapchain::depth() const { return *mDepth; }
+const MVKE::Image *MVKE::Swapchain::color() const { return mColor.get(); }
 const std::vector<vk::UniqueFramebuffer> &MVKE::Swapchain::framebuffers() const { return mFramebuffers; }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <memory>
 #include <vector>
 
 #include "mvke.hpp"
@@ -17,16 +18,24 @@ namespace MVKE {
     Swapchain(MVKE::Instance &inst);
     void initFramebuffers();
     static bool adequate(const vk::PhysicalDevice &d, MVKE::Instance &inst);
+    static std::vector<MVKE::DeviceFeature> deviceFeatures();
 
     const vk::SwapchainKHR &swapchain() const;
     const vk::Extent2D &extent() const;
     const vk::SurfaceFormatKHR &surfaceFormat() const;
+    const std::vector<vk::Image> &images() const;
+    const MVKE::Image &depth() const;
+    // The multisampled colour target, or null when rendering single-sampled.
+    const MVKE::Image *color() const;
     const std::vector<vk::UniqueFramebuffer> &framebuffers() const;
+
+    // Creates a probe image per sample count, so not for every resize.
+    void reportSampleCosts() const;
   private:
     static MVKE::SwapchainSupportDetails querySupport(const vk::PhysicalDevice &dev, MVKE::Instance &inst);
-    vk::SurfaceFormatKHR chooseSurfaceFormat(std::vector<vk::SurfaceFormatKHR> &available);
-    vk::PresentModeKHR choosePresentMode(std::vector<vk::PresentModeKHR> &available);
-    vk::Extent2D chooseExtent(vk::SurfaceCapabilitiesKHR &capabilities);
+    vk::SurfaceFormatKHR chooseSurfaceFormat(const std::vector<vk::SurfaceFormatKHR> &available);
+    vk::PresentModeKHR choosePresentMode(const std::vector<vk::PresentModeKHR> &available);
+    vk::Extent2D chooseExtent(const vk::SurfaceCapabilitiesKHR &capabilities);
     void initImages();
 
     MVKE::Instance &mInst;
@@ -38,6 +47,8 @@ namespace MVKE {
     vk::UniqueSwapchainKHR mSwapchain;
     std::vector<vk::Image> mImages;
     std::vector<vk::UniqueImageView> mImageViews;
+    std::shared_ptr<MVKE::TransientAttachment> mDepth;
+    std::shared_ptr<MVKE::TransientAttachment> mColor;
     std::vector<vk::UniqueFramebuffer> mFramebuffers;
   };
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "../reflect.hpp"
+
+#include <cstdio>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cull_comp.h"
+#include "instanced_vert.h"
+#include "shader_frag.h"
+#include "shader_vert.h"
+#include "sprite_frag.h"
+#include "sprite_vert.h"
+#include "static_vert.h"
+
+// Reflects the engine's own shaders, as embedded in libmvke, and checks the
+// results against their GLSL sources.
+static bool ok = true;
+
+static void expect(bool condition, const std::string &what) {
+  if (!condition) {
+    printf("FAIL %s\n", what.c_str());
+    ok = false;
+  }
+}
+
+template<size_t N>
+static MVKE::ShaderReflection reflect(const uint32_t (&code)[N]) {
+  return MVKE::reflectSPIRV(code, sizeof code);
+}
+
+static void expectInput(const MVKE::ShaderReflection &r, const std::string &shader, size_t i, uint32_t location, vk::Format format, uint32_t size) {
+  std::string what = shader + " input " + std::to_string(i);
+
+  if (i >= r.inputs.size()) {
+    expect(false, what + " missing");
+    return;
+  }
+
+  expect(r.inputs[i].location == location, what + " location");
+  expect(r.inputs[i].format == format, what + " format");
+  expect(r.inputs[i].size == size, what + " size");
+}
+
+static void expectBinding(const MVKE::ShaderReflection &r, const std::string &shader, size_t i, uint32_t binding, vk::DescriptorType type) {
+  std::string what = shader + " binding " + std::to_string(i);
+
+  if (i >= r.bindings.size()) {
+    expect(false, what + " missing");
+    return;
+  }
+
+  expect(r.bindings[i].set == 0, what + " set");
+  expect(r.bindings[i].binding == binding, what + " binding");
+  expect(r.bindings[i].type == type, what + " type");
+  expect(r.bindings[i].count == 1, what + " count");
+}
+
+static void expectThrows(const std::vector<uint32_t> &code, size_t size, const std::string &what) {
+  try {
+    MVKE::reflectSPIRV(code.data(), size);
+    expect(false, what + " did not throw");
+  } catch (std::runtime_error &) {
+  }
+}
+
+int main(int argc, char **argv) {
+  using Format = vk::Format;
+
+  auto vert = reflect(shader_vert);
+  expect(vert.stage == vk::ShaderStageFlagBits::eVertex, "shader.vert stage");
+  expect(vert.inputs.size() == 2, "shader.vert input count");
+  expectInput(vert, "shader.vert", 0, 0, Format::eR32G32Sfloat, 8);
+  expectInput(vert, "shader.vert", 1, 1, Format::eR32G32B32Sfloat, 12);
+  expect(vert.bindings.empty(), "shader.vert bindings");
+  expect(vert.pushConstantSize == 0, "shader.vert push constants");
+
+  auto frag = reflect(shader_frag);
+  expect(frag.stage == vk::ShaderStageFlagBits::eFragment, "shader.frag stage");
+  expect(frag.inputs.size() == 1, "shader.frag input count");
+  expectInput(frag, "shader.frag", 0, 0, Format::eR32G32B32Sfloat, 12);
+
+  // The mat4 takes locations 2 to 5, one per column.
+  auto instanced = reflect(instanced_vert);
+  expect(instanced.inputs.size() == 8, "instanced.vert input count");
+  expectInput(instanced, "instanced.vert", 0, 0, Format::eR32G32Sfloat, 8);
+  expectInput(instanced, "instanced.vert", 1, 1, Format::eR32G32B32Sfloat, 12);
+
+  for (uint32_t c = 0; c < 4; ++c) {
+    expectInput(instanced, "instanced.vert", 2 + c, 2 + c, Format::eR32G32B32A32Sfloat, 16);
+  }
+
+  expectInput(instanced, "instanced.vert", 6, 6, Format::eR32G32B32A32Sfloat, 16);
+  expectInput(instanced, "instanced.vert", 7, 7, Format::eR32Uint, 4);
+
+  auto spriteVert = reflect(sprite_vert);
+  expect(spriteVert.inputs.size() == 3, "sprite.vert input count");
+  expect(spriteVert.pushConstantSize == 16, "sprite.vert push constants");
+
+  auto spriteFrag = reflect(sprite_frag);
+  expect(spriteFrag.bindings.size() == 1, "sprite.frag binding count");
+  expectBinding(spriteFrag, "sprite.frag", 0, 0, vk::DescriptorType::eCombinedImageSampler);
+
+  auto staticVert = reflect(static_vert);
+  expect(staticVert.bindings.size() == 1, "static.vert binding count");
+  expectBinding(staticVert, "static.vert", 0, 0, vk::DescriptorType::eStorageBuffer);
+
+  // Six planes and the object count.
+  auto cull = reflect(cull_comp);
+  expect(cull.stage == vk::ShaderStageFlagBits::eCompute, "cull.comp stage");
+  expect(cull.localSize == std::array<uint32_t, 3>{64, 1, 1}, "cull.comp local size");
+  expect(cull.inputs.empty(), "cull.comp inputs");
+  expect(cull.pushConstantSize == 6 * 16 + 4, "cull.comp push constants");
+  expect(cull.bindings.size() == 3, "cull.comp binding count");
+
+  for (uint32_t b = 0; b < 3; ++b) {
+    expectBinding(cull, "cull.comp", b, b, vk::DescriptorType::eStorageBuffer);
+  }
+
+  std::vector<uint32_t> module(std::begin(shader_vert), std::end(shader_vert));
+  expectThrows(module, 16, "a module shorter than its header");
+
+  // The first instruction claims to run past the end.
+  std::vector<uint32_t> truncated = module;
+  truncated[5] = (truncated[5] & 0xffff) | 0xffff0000;
+  expectThrows(truncated, truncated.size() * sizeof truncated[0], "a truncated module");
+
+  std::vector<uint32_t> badMagic = module;
+  badMagic[0] = 0xdeadbeef;
+  expectThrows(badMagic, badMagic.size() * sizeof badMagic[0], "a bad magic number");
+
+  // sampler samplers[4], with the length's constant, its type and the
+  // header's id bound varied below.
+  auto arrayModule = [](uint32_t lengthOp, uint32_t width, uint32_t bound) {
+    std::vector<uint32_t> code = {0x07230203, 0x00010000, 0, bound, 0};
+    std::vector<uint32_t> body = {
+      (4 << 16) | 21, 1, width, 0,
+      (width == 64 ? 5u : 4u) << 16 | lengthOp, 1, 2, 4,
+    };
+
+    if (width == 64) body.push_back(0);
+
+    std::vector<uint32_t> rest = {
+      (2 << 16) | 26, 3,
+      (4 << 16) | 28, 4, 3, 2,
+      (4 << 16) | 32, 5, 0, 4,
+      (4 << 16) | 59, 5, 6, 0,
+    };
+
+    code.insert(code.end(), body.begin(), body.end());
+    code.insert(code.end(), rest.begin(), rest.end());
+    return code;
+  };
+
+  auto array = arrayModule(43, 32, 7);
+  auto arrayRefl = MVKE::reflectSPIRV(array.data(), array.size() * sizeof array[0]);
+  expect(arrayRefl.bindings.size() == 1 && arrayRefl.bindings[0].count == 4, "a constant array length");
+
+  auto spec = arrayModule(50, 32, 7);
+  expectThrows(spec, spec.size() * sizeof spec[0], "a specialization constant array length");
+
+  auto wide = arrayModule(43, 64, 7);
+  expectThrows(wide, wide.size() * sizeof wide[0], "a 64-bit array length");
+
+  // The variable's id is past the bound.
+  auto outOfBounds = arrayModule(43, 32, 6);
+  expectThrows(outOfBounds, outOfBounds.size() * sizeof outOfBounds[0], "an id past the bound");
+
+  if (ok) printf("ok   reflect\n");
+
+  return ok ? 0 : 1;
+}
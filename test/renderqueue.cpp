@@ -0,0 +1,71 @@
+#include "../renderqueue.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Sorts random keys with RenderQueue and checks the order against
+// std::stable_sort. Each draw's firstInstance holds the order it was pushed
+// in, so equal keys also check stability.
+static bool check(const char *name, size_t count, const std::function<uint64_t()> &next) {
+  MVKE::RenderQueue queue(4);
+  std::vector<std::pair<uint64_t, uint32_t>> expected;
+
+  for (size_t i = 0; i < count; ++i) {
+    MVKE::RenderQueue::Draw draw;
+    draw.firstInstance = i;
+
+    uint64_t key = next();
+    queue.push(key, draw);
+    expected.push_back({key, static_cast<uint32_t>(i)});
+  }
+
+  std::stable_sort(expected.begin(), expected.end(), [](const auto &a, const auto &b) {
+    return a.first < b.first;
+  });
+
+  queue.sort();
+
+  if (!queue.sorted() || queue.size() != count) {
+    printf("FAIL %s (%zu): queue not sorted\n", name, count);
+    return false;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (queue.key(i) != expected[i].first || queue.draw(i).firstInstance != expected[i].second) {
+      printf("FAIL %s (%zu): position %zu holds %016llx from %u, expected %016llx from %u\n", name, count, i,
+        static_cast<unsigned long long>(queue.key(i)), queue.draw(i).firstInstance,
+        static_cast<unsigned long long>(expected[i].first), expected[i].second);
+      return false;
+    }
+  }
+
+  printf("ok   %s (%zu)\n", name, count);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::mt19937_64 rng(argc > 1 ? std::stoull(argv[1]) : 1);
+
+  const size_t threshold = MVKE::RenderQueue::sParallelThreshold;
+  const size_t counts[] = {0, 1, 100, threshold - 1, threshold, threshold + 1, 100000};
+
+  bool ok = true;
+
+  for (size_t count : counts) {
+    ok &= check("random", count, [&] { return rng(); });
+    // Few distinct keys: long runs of equal keys must keep their order.
+    ok &= check("duplicates", count, [&] { return rng() % 16; });
+    // Only the middle digits differ, so the others are skipped.
+    ok &= check("shared digits", count, [&] { return 0xa500000000000000ull | (rng() & 0xffff0000ull); });
+    ok &= check("opaque keys", count, [&] {
+      return MVKE::RenderQueue::opaqueKey(rng() % 2, rng() % 8, rng() % 32, rng() % 64, (rng() % 1000) / 1000.0f);
+    });
+  }
+
+  return ok ? 0 : 1;
+}
@@ -1,9 +1,43 @@
 #include "../mvke.hpp"
+#include "../instancing.hpp"
+#include "../debugdraw.hpp"
 
 #include <string>
 
 int main(int argc, char **argv) {
   MVKE::Instance mvke("Test Application", 1, 0, 0);
-  mvke.mainLoop();
+
+  mvke.mainLoop([&mvke](size_t imageIndex) {
+    // A grid of small copies of the quad behind the big one.
+    const uint32_t side = 100;
+    const float cell = 2.0f / side;
+
+    MVKE::InstanceData *data = mvke.instanceBatch().allocate(side * side);
+
+    for (uint32_t y = 0; y < side; ++y) {
+      for (uint32_t x = 0; x < side; ++x) {
+        MVKE::InstanceData &d = data[y * side + x];
+        glm::vec3 offset(-1.0f + (x + 0.5f) * cell, -1.0f + (y + 0.5f) * cell, 0.5f);
+
+        d.transform = glm::mat4(1.0f);
+        d.transform[0][0] = d.transform[1][1] = cell * 0.5f;
+        d.transform[3] = glm::vec4(offset, 1.0f);
+        d.color = glm::vec4(float(x) / side, float(y) / side, 1.0f, 1.0f);
+        d.id = y * side + x;
+      }
+    }
+
+    // Outlines of the static corner quads, and a circle drawn over
+    // everything.
+    MVKE::DebugDraw &debug = mvke.debugDraw();
+
+    for (int i = 0; i < 4; ++i) {
+      glm::vec3 center(i & 1 ? 0.75f : -0.75f, i & 2 ? 0.75f : -0.75f, 0.25f);
+      debug.box(center - glm::vec3(0.175f, 0.175f, 0.0f), center + glm::vec3(0.175f, 0.175f, 0.0f), 0xff00ff00);
+    }
+
+    debug.circle(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), 0.5f, 0xff0000ff, false, 64);
+  });
+
   return 0;
 }